@@ -10,11 +10,23 @@
 #include "libopencm3/stm32/dma.h"
 #include "libopencm3/stm32/gpio.h"
 #include "libopencm3/stm32/rcc.h"
+#include "libopencm3/stm32/timer.h"
+#include "libopencm3/cm3/nvic.h"
 #include "lcd.h"
+#include "sched.h"
 #include "stdio.h"
 
-/** @brief Number of ADC samples to collect for each channel in DMA. */
-#define ADC_SAMPLE_COUNT 10
+/** @brief Sample pairs per second, paced by Timer 3. */
+#define ADC_SAMPLE_RATE_HZ 5000
+
+/** @brief Timer 3 prescaler: 72 MHz / 72 = 1 MHz. */
+#define ADC_TRIGGER_PRESCALER 72
+
+/** @brief Timer 3 ticks between two conversion scans. */
+#define ADC_TRIGGER_PERIOD (1000000UL / ADC_SAMPLE_RATE_HZ)
+
+/** @brief Number of ADC samples of each channel per block (one 50 Hz cycle). */
+#define ADC_SAMPLE_COUNT 100
 
 /** @brief Number of channels to be sampled by the ADC. */
 #define ADC_CHANNEL_COUNT 2
@@ -38,11 +50,17 @@
 /** @brief ADC sample time configuration. */
 #define SAMPLE_TIME_CYCLES ADC_SMPR_SMP_28DOT5CYC
 
+/** @brief Interleaved samples in one block. */
+#define ADC_BLOCK_SIZE (ADC_SAMPLE_COUNT * ADC_CHANNEL_COUNT)
+
+/** @brief Number of blocks in the DMA buffer (double buffering). */
+#define ADC_BLOCK_COUNT 2
+
 /** @brief ADC buffer size. */
-#define ADC_BUFFER_SIZE (ADC_SAMPLE_COUNT * ADC_CHANNEL_COUNT)  // Tamaño del buffer para almacenar las muestras ADC
+#define ADC_BUFFER_SIZE (ADC_BLOCK_SIZE * ADC_BLOCK_COUNT)  // Tamaño del buffer para almacenar las muestras ADC
 
 
-static volatile uint16_t ADC_BUFFER[ADC_BUFFER_SIZE];  // Buffer compartido para ambos canales ADC
+extern volatile uint16_t ADC_BUFFER[ADC_BUFFER_SIZE];  // Buffer compartido para ambos canales ADC
 
 /**
  * @brief Configures ADC pins and initializes DMA for sensor data acquisition.
@@ -56,10 +74,40 @@ static volatile uint16_t ADC_BUFFER[ADC_BUFFER_SIZE];  // Buffer compartido para
  * in a buffer for further processing. The ADC channels, DMA settings, and sampling times
  * are configured according to the application requirements (e.g., voltage and current sensors).
  * 
+ * Timer 3 triggers one scan of both channels every 1/`ADC_SAMPLE_RATE_HZ` seconds. The
+ * DMA buffer holds two blocks of `ADC_SAMPLE_COUNT` pairs: the half-transfer and
+ * transfer-complete interrupts hand each block over while the other one is filled.
+ * 
  * The function should be called once at the start of the program to initialize the hardware
  * before any ADC readings are taken.
  */
 void config_adc_dma(void);
 
+/**
+ * @brief Returns the last completed block of samples.
+ *
+ * The block stays untouched by the DMA for one block time (20 ms) after it is handed over.
+ *
+ * @return First of the `ADC_BLOCK_SIZE` interleaved (voltage, current) samples.
+ */
+const volatile uint16_t *adc_get_latest_block(void);
+
+/**
+ * @brief Returns the number of blocks completed since start-up.
+ *
+ * @return Block counter.
+ */
+uint32_t adc_get_block_count(void);
+
+/**
+ * @brief Returns the number of blocks lost since start-up.
+ *
+ * A block is lost when its interrupt runs so late that the DMA is already writing it
+ * again; it is then neither handed over nor counted by `adc_get_block_count()`.
+ *
+ * @return Lost block counter.
+ */
+uint32_t adc_get_lost_blocks(void);
+
 
 
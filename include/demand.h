@@ -0,0 +1,100 @@
+/**
+ * @file demand.h
+ * @brief Demand metering (block and rolling demand with peak registers).
+ *
+ * This file provides the definitions and prototypes of the demand module. The module
+ * is fed once per second with the energy integrated during that second and keeps:
+ * - Block demand: average power over fixed, clock-aligned intervals (e.g. 15 minutes).
+ * - Rolling demand: average power over a sliding window built from a ring of sub-intervals.
+ * - Peak registers with timestamps for both of them (e.g. the monthly maximum demand).
+ *
+ * Memory use is constant and every update is O(1), regardless of the window length.
+ */
+
+#ifndef DEMAND_H
+#define DEMAND_H
+
+#include <stdint.h>
+
+/** @brief Maximum number of sub-intervals held in the rolling demand ring. */
+#define DEMAND_MAX_SUBINTERVALS 15
+
+/** @brief Default block demand interval in seconds (15 minutes). */
+#define DEMAND_DEFAULT_BLOCK_S 900
+
+/** @brief Default rolling demand sub-interval in seconds (1 minute). */
+#define DEMAND_DEFAULT_SUBINTERVAL_S 60
+
+/** @brief Default number of sub-intervals in the rolling window (15 x 1 minute). */
+#define DEMAND_DEFAULT_SUBINTERVALS 15
+
+/** @brief Energy unit fed to the module: milliwatt-seconds (mJ) per second. */
+#define DEMAND_MWS_PER_WS 1000
+
+/**
+ * @brief Peak demand register.
+ */
+typedef struct {
+    uint32_t demand_w;     /**< Peak demand in watts. */
+    uint32_t timestamp_s;  /**< Meter time (seconds) at the end of the interval that set the peak. */
+} demand_peak_t;
+
+/**
+ * @brief Configures the demand intervals and clears every register.
+ *
+ * Zero values select the defaults and the number of sub-intervals is limited
+ * to `DEMAND_MAX_SUBINTERVALS`.
+ *
+ * @param block_s Block demand interval in seconds.
+ * @param subinterval_s Length of each rolling sub-interval in seconds.
+ * @param subintervals Number of sub-intervals in the rolling window.
+ */
+void demand_init(uint16_t block_s, uint16_t subinterval_s, uint8_t subintervals);
+
+/**
+ * @brief Adds the energy of one elapsed second.
+ *
+ * Must be called once per meter second. Interval boundaries are aligned to the
+ * timestamp, so a 900 s block always closes on the quarter hour of the meter clock.
+ *
+ * @param energy_mws Energy consumed during the second in milliwatt-seconds.
+ * @param timestamp_s Meter time of the second being added, in seconds.
+ */
+void demand_push_second(uint32_t energy_mws, uint32_t timestamp_s);
+
+/**
+ * @brief Returns the demand of the last completed block.
+ *
+ * @return Block demand in watts.
+ */
+uint32_t demand_get_block_w(void);
+
+/**
+ * @brief Returns the rolling demand over the configured sliding window.
+ *
+ * The value is refreshed at the end of every sub-interval.
+ *
+ * @return Rolling demand in watts.
+ */
+uint32_t demand_get_rolling_w(void);
+
+/**
+ * @brief Returns the peak block demand register.
+ *
+ * @return Peak block demand and the time it was recorded.
+ */
+demand_peak_t demand_get_block_peak(void);
+
+/**
+ * @brief Returns the peak rolling demand register.
+ *
+ * @return Peak rolling demand and the time it was recorded.
+ */
+demand_peak_t demand_get_rolling_peak(void);
+
+/**
+ * @brief Clears both peak registers (e.g. at the start of a billing month).
+ */
+void demand_reset_peaks(void);
+
+#endif
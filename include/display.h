@@ -0,0 +1,189 @@
+/**
+ * @file display.h
+ * @brief Character display layer over interchangeable backends.
+ *
+ * The UI writes text into a shadow framebuffer of character cells. `display_flush()`
+ * compares it with what the display shows and hands the changed cells, grouped per row
+ * into runs, to the backend selected by `DISPLAY_BACKEND`. A backend only has to place
+ * a run of characters at a cell position; how it gets there (HD44780 commands through
+ * the PCF8574, or a rendered OLED framebuffer pushed by DMA) is its own business.
+ *
+ * Character codes 8 to 15 are the eight user-defined glyphs (`glyph.h`) on backends
+ * with `DISPLAY_CAP_GLYPHS`; 0xFF is a full block on all of them.
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+
+/** @brief Backend: HD44780 16x4 behind a PCF8574. */
+#define DISPLAY_BACKEND_HD44780_16X4 0
+
+/** @brief Backend: HD44780 20x4 behind a PCF8574. */
+#define DISPLAY_BACKEND_HD44780_20X4 1
+
+/** @brief Backend: SSD1306 128x64 OLED, 21x8 characters of 6x8 pixels. */
+#define DISPLAY_BACKEND_SSD1306 2
+
+/** @brief Display driven by `display_init()`. */
+#ifndef DISPLAY_BACKEND
+#define DISPLAY_BACKEND DISPLAY_BACKEND_HD44780_16X4
+#endif
+
+/** @brief Most rows of any backend. */
+#define DISPLAY_MAX_ROWS 8
+
+/** @brief Most columns of any backend. */
+#define DISPLAY_MAX_COLS 21
+
+/** @brief Unchanged cells between two changed runs that are rewritten to merge them into one run. */
+#define DISPLAY_MERGE_GAP 1
+
+/** @brief Capability: eight user-defined 5x8 glyphs shown with codes 8 to 15. */
+#define DISPLAY_CAP_GLYPHS 0x01
+
+/** @brief Rows of a user-defined glyph. */
+#define DISPLAY_GLYPH_ROWS 8
+
+/**
+ * @brief What a backend can show.
+ */
+typedef struct {
+    uint8_t rows;   /**< Character rows (up to `DISPLAY_MAX_ROWS`). */
+    uint8_t cols;   /**< Character columns (up to `DISPLAY_MAX_COLS`). */
+    uint8_t flags;  /**< `DISPLAY_CAP_` flags. */
+} display_caps_t;
+
+/**
+ * @brief Backend interface.
+ *
+ * None of the functions may wait on the display; they queue work and return.
+ */
+typedef struct {
+    display_caps_t caps;  /**< Geometry and capabilities. */
+
+    /** Starts the hardware and its initialisation; the screen is blank afterwards. */
+    void (*init)(void);
+
+    /**
+     * Places `length` characters from `text` at a cell, all or nothing.
+     * Returns 1 if accepted, 0 if there is no room now (retried on the next flush).
+     */
+    uint8_t (*write_run)(uint8_t row, uint8_t col, const char *text, uint8_t length);
+
+    /** Moves the text cursor, for direct printing. Returns 1 if accepted. */
+    uint8_t (*set_cursor)(uint8_t row, uint8_t col);
+
+    /** Starts sending what the runs queued. */
+    void (*flush)(void);
+
+    /**
+     * Recovers from a transfer error if one occurred and the bus is idle. Returns
+     * non-zero if the display was reinitialised, so every cell must be rewritten and
+     * every glyph redefined.
+     */
+    uint8_t (*recover)(void);
+
+    /**
+     * Defines glyph `slot` (0 to 7) from `DISPLAY_GLYPH_ROWS` rows of 5 bits. Cells
+     * already showing it change too. Returns 1 if accepted, 0 if there is no room now.
+     * NULL without `DISPLAY_CAP_GLYPHS`.
+     */
+    uint8_t (*define_glyph)(uint8_t slot, const uint8_t rows[DISPLAY_GLYPH_ROWS]);
+} display_driver_t;
+
+/**
+ * @brief Initialises the `DISPLAY_BACKEND` display and clears the framebuffer.
+ *
+ * Requires `systick_setup()` and `timebase_init()`, which `main()` runs first.
+ */
+void display_init(void);
+
+/**
+ * @brief Returns the geometry and capabilities of the display.
+ *
+ * @return Capabilities of the backend.
+ */
+const display_caps_t *display_get_caps(void);
+
+/**
+ * @brief Writes a string into the shadow framebuffer.
+ *
+ * Nothing is sent until `display_flush()`. Characters past the end of the row are
+ * dropped.
+ *
+ * @param row Row.
+ * @param col First column.
+ * @param str Null-terminated string.
+ */
+void display_write(uint8_t row, uint8_t col, const char *str);
+
+/**
+ * @brief Writes a whole row into the shadow framebuffer, padded with spaces.
+ *
+ * @param row Row.
+ * @param str Null-terminated string; characters past the last column are dropped.
+ */
+void display_write_line(uint8_t row, const char *str);
+
+/**
+ * @brief Fills the shadow framebuffer with spaces.
+ */
+void display_clear(void);
+
+/**
+ * @brief Marks every cell as changed so the next flush redraws the whole screen.
+ */
+void display_invalidate(void);
+
+/**
+ * @brief Sends the cells of the shadow framebuffer that differ from the display.
+ *
+ * Changed cells are grouped per row into runs. A run the backend cannot take yet
+ * stays pending for the next flush. If a transfer failed, the backend is recovered
+ * first and the whole screen redrawn.
+ *
+ * @return Number of cells handed to the backend.
+ */
+uint16_t display_flush(void);
+
+/**
+ * @brief Tells whether the last flush left cells the backend had no room for.
+ *
+ * @return Non-zero until a flush sends every changed cell.
+ */
+uint8_t display_has_backlog(void);
+
+/**
+ * @brief Called by a backend, from interrupt context, once it has room again.
+ *
+ * Posts `SCHED_EVENT_I2C` only while the last flush left a backlog, so the display
+ * task is woken to push the rest, and not by every bus transaction.
+ */
+void display_backend_ready(void);
+
+/**
+ * @brief Moves the backend text cursor (direct printing only).
+ *
+ * @return 1 if accepted.
+ */
+uint8_t display_set_cursor(uint8_t row, uint8_t col);
+
+/**
+ * @brief Defines a user-defined glyph.
+ *
+ * @param slot Glyph 0 to 7 (character code 8 + `slot`).
+ * @param rows `DISPLAY_GLYPH_ROWS` rows, 5 low bits each, top row first.
+ * @return 1 if accepted, 0 if there is no room now or the display has no glyphs.
+ */
+uint8_t display_define_glyph(uint8_t slot, const uint8_t rows[DISPLAY_GLYPH_ROWS]);
+
+/**
+ * @brief Times the display was reinitialised after a transfer error.
+ *
+ * @return Counter since start-up.
+ */
+uint32_t display_get_resyncs(void);
+
+#endif
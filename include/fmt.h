@@ -0,0 +1,155 @@
+/**
+ * @file fmt.h
+ * @brief Allocation-free number formatting for the display and telemetry.
+ *
+ * A small replacement for `snprintf()` on the hot path. Text is appended to a caller
+ * buffer through an `fmt_t` writer that always keeps it null-terminated and silently
+ * truncates at its size, so a formatted field can never overrun. There is no heap, no
+ * varargs and no floating-point formatting code: fractional values are printed from
+ * scaled integers with integer division only.
+ *
+ * Typical use:
+ * @code
+ * fmt_t f;
+ * fmt_init(&f, line, sizeof(line));
+ * fmt_str(&f, "U ");
+ * fmt_uint(&f, volts, 3);
+ * fmt_str(&f, " V");
+ * @endcode
+ *
+ * With `FMT_BENCHMARK` set, `fmt_benchmark()` times a representative line against
+ * `snprintf()` with the DWT cycle counter. Code size is compared with `arm-none-eabi-size`
+ * on builds with and without `snprintf()` referenced.
+ *
+ * @note Neither gain has been measured on hardware yet: no cycle counts or `.text`
+ * sizes are recorded for this module.
+ */
+
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdint.h>
+
+/** @brief Non-zero to build `fmt_benchmark()` (pulls in `snprintf()`). */
+#ifndef FMT_BENCHMARK
+#define FMT_BENCHMARK 0
+#endif
+
+/** @brief Most decimals accepted by the fixed-point functions. */
+#define FMT_MAX_DECIMALS 6
+
+/** @brief Power at and above which `fmt_power()` switches from W to kW. */
+#define FMT_KILO_THRESHOLD_W 1000.0f
+
+/**
+ * @brief Bounded writer over a caller buffer.
+ */
+typedef struct {
+    char *buffer;    /**< Destination, always null-terminated. */
+    uint8_t size;    /**< Size of `buffer` including the terminator. */
+    uint8_t length;  /**< Characters written so far. */
+} fmt_t;
+
+/**
+ * @brief Starts writing into a buffer (the buffer becomes an empty string).
+ *
+ * @param f Writer.
+ * @param buffer Destination.
+ * @param size Size of the destination including the terminator (at least 1).
+ */
+void fmt_init(fmt_t *f, char *buffer, uint8_t size);
+
+/**
+ * @brief Appends one character.
+ */
+void fmt_char(fmt_t *f, char c);
+
+/**
+ * @brief Appends a null-terminated string.
+ */
+void fmt_str(fmt_t *f, const char *str);
+
+/**
+ * @brief Appends spaces until the text is `length` characters long.
+ *
+ * @param f Writer.
+ * @param length Total length to reach.
+ */
+void fmt_pad(fmt_t *f, uint8_t length);
+
+/**
+ * @brief Appends an unsigned integer.
+ *
+ * @param f Writer.
+ * @param value Value.
+ * @param width Minimum width, right-aligned with spaces (0: no padding).
+ */
+void fmt_uint(fmt_t *f, uint32_t value, uint8_t width);
+
+/**
+ * @brief Appends a signed integer (a minus sign for negative values only).
+ *
+ * @param f Writer.
+ * @param value Value.
+ * @param width Minimum width including the sign, right-aligned with spaces.
+ */
+void fmt_int(fmt_t *f, int32_t value, uint8_t width);
+
+/**
+ * @brief Appends a fixed-point value held as a scaled integer.
+ *
+ * For example `fmt_fixed(&f, 1234, 2, 0)` appends `12.34`.
+ *
+ * @param f Writer.
+ * @param value Value x 10^`decimals`.
+ * @param decimals Digits after the decimal point (0 to `FMT_MAX_DECIMALS`).
+ * @param width Minimum width including sign and point, right-aligned with spaces.
+ */
+void fmt_fixed(fmt_t *f, int32_t value, uint8_t decimals, uint8_t width);
+
+/**
+ * @brief Appends a float rounded to a number of decimals.
+ *
+ * The value is scaled and rounded to an integer, then printed by `fmt_fixed()`;
+ * values out of the 32-bit range are clamped.
+ *
+ * @param f Writer.
+ * @param value Value.
+ * @param decimals Digits after the decimal point (0 to `FMT_MAX_DECIMALS`).
+ * @param width Minimum width including sign and point, right-aligned with spaces.
+ */
+void fmt_float(fmt_t *f, float value, uint8_t decimals, uint8_t width);
+
+/**
+ * @brief Appends a power with an automatic unit.
+ *
+ * Below `FMT_KILO_THRESHOLD_W` the power is printed in whole watts (`"850W"`), above it
+ * in kilowatts with three significant digits (`"1.23kW"`, `"12.3kW"`, `"123kW"`).
+ *
+ * @param f Writer.
+ * @param watts Power in W.
+ * @param width Minimum width including the unit, right-aligned with spaces.
+ */
+void fmt_power(fmt_t *f, float watts, uint8_t width);
+
+#if FMT_BENCHMARK
+/**
+ * @brief Cycle counts of one formatted line.
+ */
+typedef struct {
+    uint32_t fmt_cycles;       /**< Cycles taken by the `fmt` functions. */
+    uint32_t snprintf_cycles;  /**< Cycles taken by `snprintf()` for the same text. */
+    uint8_t match;             /**< Non-zero if both produced the same text. */
+} fmt_benchmark_t;
+
+/**
+ * @brief Formats a display line with both implementations and times them.
+ *
+ * Requires `timebase_init()`.
+ *
+ * @return Cycle counts and whether the outputs match.
+ */
+fmt_benchmark_t fmt_benchmark(void);
+#endif
+
+#endif
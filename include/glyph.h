@@ -0,0 +1,101 @@
+/**
+ * @file glyph.h
+ * @brief Custom character manager for the display glyphs, with bar graph and sparkline rendering.
+ *
+ * Displays with `DISPLAY_CAP_GLYPHS` have eight user-defined 5x8 characters (the
+ * HD44780 CGRAM, emulated in RAM on the OLED). The manager maps glyph patterns
+ * to those slots: a pattern already resident is reused, a new one takes a free slot
+ * or the least recently used one not needed by the current frame. Uploads are only
+ * queued by `glyph_flush()`, once per changed slot, so redrawing the same bars and
+ * sparklines costs no glyph traffic.
+ *
+ * Glyphs are displayed with character codes 8 to 15 (the HD44780 mirror of 0 to 7),
+ * so they can be embedded in null-terminated strings. On a display without glyphs,
+ * `glyph_get()` always returns the fallback character.
+ */
+
+#ifndef GLYPH_H
+#define GLYPH_H
+
+#include <stdint.h>
+#include "display.h"
+
+/** @brief Number of user-defined glyph slots. */
+#define GLYPH_SLOTS 8
+
+/** @brief Rows of a 5x8 glyph. */
+#define GLYPH_ROWS DISPLAY_GLYPH_ROWS
+
+/** @brief Pixel columns of a glyph (and of a character cell). */
+#define GLYPH_COLUMNS 5
+
+/** @brief Character code of glyph slot 0 (codes 8 to 15 address slots 0 to 7). */
+#define GLYPH_CODE_BASE 8
+
+/** @brief Character with every pixel on (HD44780 A00 ROM; drawn the same by the OLED). */
+#define GLYPH_FULL_BLOCK ((char)0xFF)
+
+/** @brief Character shown when no slot is available for a glyph. */
+#define GLYPH_FALLBACK '#'
+
+/**
+ * @brief Forgets every slot; the next frame uploads what it uses.
+ */
+void glyph_init(void);
+
+/**
+ * @brief Starts a frame: slots stop counting as in use until requested again.
+ */
+void glyph_begin_frame(void);
+
+/**
+ * @brief Returns the character code displaying a pattern.
+ *
+ * @param pattern `GLYPH_ROWS` rows, 5 low bits each, top row first.
+ * @param fallback Character returned if every slot is in use by the current frame.
+ * @return Code 8 to 15, or `fallback`.
+ */
+char glyph_get(const uint8_t pattern[GLYPH_ROWS], char fallback);
+
+/**
+ * @brief Queues the uploads of the slots assigned since the last flush.
+ *
+ * Must run before the framebuffer flush of the frame that uses the glyphs. A slot
+ * the display cannot take yet stays pending for the next flush.
+ *
+ * @return Number of slots uploaded.
+ */
+uint8_t glyph_flush(void);
+
+/**
+ * @brief Number of glyph uploads queued since start-up.
+ *
+ * @return Counter.
+ */
+uint32_t glyph_get_uploads(void);
+
+/**
+ * @brief Renders a horizontal bar with one-column resolution.
+ *
+ * Full cells use the ROM full block, the partial cell a glyph with 1 to 4 columns
+ * lit, the rest spaces.
+ *
+ * @param out Destination, `cells` characters plus the terminator.
+ * @param cells Width of the bar in characters.
+ * @param value Value to show (clamped to `full_scale`).
+ * @param full_scale Value of a full bar.
+ */
+void glyph_bar(char *out, uint8_t cells, float value, float full_scale);
+
+/**
+ * @brief Renders one sample per cell as a column of 0 to 8 pixels.
+ *
+ * @param out Destination, `count` characters plus the terminator.
+ * @param samples Samples, oldest first.
+ * @param count Number of samples.
+ * @param low Value shown as an empty cell.
+ * @param high Value shown as a full cell; if not above `low`, the range of the samples is used.
+ */
+void glyph_sparkline(char *out, const float *samples, uint8_t count, float low, float high);
+
+#endif
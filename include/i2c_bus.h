@@ -0,0 +1,177 @@
+/**
+ * @file i2c_bus.h
+ * @brief Interrupt-driven I2C1 master for write and single-byte read transactions.
+ *
+ * A transaction is started with `i2c_bus_write()` or `i2c_bus_read()` and runs
+ * entirely from the I2C1 event and error interrupts; the callback is invoked from
+ * interrupt context when the stop condition has been sent or the transfer failed. Only
+ * one transaction is in flight at a time.
+ *
+ * Transactions of `I2C_BUS_DMA_MIN_LENGTH` bytes or more are fed to the data register
+ * by DMA1 channel 6 (I2C1_TX) instead of one interrupt per byte, which is what makes
+ * pushing a 129-byte OLED page cheap; the event interrupt then only handles the start,
+ * the address and the final stop.
+ *
+ * Every transaction has a deadline. `i2c_bus_poll()`, called from the SysTick
+ * interrupt, aborts a transaction that overruns it and recovers the bus, so a stuck
+ * line or a missing slave costs a failed transfer instead of a frozen system. Bus
+ * errors and lost arbitration trigger the same recovery.
+ */
+
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdint.h>
+#include "libopencm3/stm32/gpio.h"
+#include "libopencm3/stm32/i2c.h"
+#include "libopencm3/stm32/rcc.h"
+#include "libopencm3/stm32/dma.h"
+#include "libopencm3/cm3/nvic.h"
+#include "timebase.h"
+
+/** @brief STM32 SDA pin (PB7). */
+#define I2C_BUS_SDA_PIN GPIO7
+
+/** @brief STM32 SCL pin (PB6). */
+#define I2C_BUS_SCL_PIN GPIO6
+
+/** @brief Non-zero for fast mode (400 kHz), zero for standard mode (100 kHz). */
+#ifndef I2C_BUS_FAST_MODE
+#define I2C_BUS_FAST_MODE 1
+#endif
+
+/** @brief APB1 clock feeding I2C1, in MHz. */
+#define I2C_BUS_PCLK_MHZ 36
+
+/** @brief Fast mode CCR (duty 2): 36 MHz / (3 x 30) = 400 kHz. */
+#define I2C_BUS_CCR_FAST 30
+
+/** @brief Fast mode TRISE: 300 ns x 36 MHz + 1. */
+#define I2C_BUS_TRISE_FAST 11
+
+/** @brief Standard mode CCR: 36 MHz / (2 x 180) = 100 kHz. */
+#define I2C_BUS_CCR_STANDARD 180
+
+/** @brief Standard mode TRISE: 1000 ns x 36 MHz + 1. */
+#define I2C_BUS_TRISE_STANDARD 37
+
+/** @brief DMA1 channel serving the I2C1_TX request. */
+#define I2C_BUS_DMA_CHANNEL DMA_CHANNEL6
+
+/** @brief Shortest transaction sent by DMA; shorter ones are fed byte by byte from the interrupt. */
+#define I2C_BUS_DMA_MIN_LENGTH 16
+
+/** @brief Fixed part of the transaction deadline (start, address, stop), in microseconds. */
+#define I2C_BUS_TIMEOUT_BASE_US 1000
+
+/** @brief Deadline allowance per data byte, in microseconds (a byte takes 90 us at 100 kHz). */
+#define I2C_BUS_TIMEOUT_PER_BYTE_US 200
+
+/**
+ * @brief Deadline of a transaction of `length` bytes, in 1 ms SysTick periods.
+ *
+ * Rounded up, plus one period because the first tick can come right after the start.
+ */
+#define I2C_BUS_TIMEOUT_TICKS(length) \
+    ((uint16_t)((I2C_BUS_TIMEOUT_BASE_US + (uint32_t)(length) * I2C_BUS_TIMEOUT_PER_BYTE_US + 999) / 1000 + 1))
+
+/** @brief SCL clock pulses sent to free a slave holding SDA low. */
+#define I2C_BUS_RECOVERY_PULSES 9
+
+/** @brief Half period of the recovery clock, in microseconds (100 kHz). */
+#define I2C_BUS_RECOVERY_HALF_US 5
+
+/** @brief Transaction completed. */
+#define I2C_BUS_OK 0
+
+/** @brief The slave did not acknowledge the address or a data byte. */
+#define I2C_BUS_NACK 1
+
+/** @brief Bus error or arbitration lost. */
+#define I2C_BUS_ERROR 2
+
+/** @brief The transaction overran its deadline. */
+#define I2C_BUS_TIMEOUT 3
+
+/**
+ * @brief Error counters since start-up.
+ */
+typedef struct {
+    uint32_t nacks;       /**< Address or data not acknowledged. */
+    uint32_t bus_errors;  /**< Misplaced start/stop, overrun or arbitration lost. */
+    uint32_t timeouts;    /**< Transactions aborted at their deadline. */
+    uint32_t recoveries;  /**< Bus recovery sequences run. */
+} i2c_bus_stats_t;
+
+/**
+ * @brief Completion callback, called from interrupt context.
+ *
+ * @param status `I2C_BUS_OK`, `I2C_BUS_NACK`, `I2C_BUS_ERROR` or `I2C_BUS_TIMEOUT`.
+ */
+typedef void (*i2c_bus_callback_t)(uint8_t status);
+
+/**
+ * @brief Configures PB6/PB7, I2C1 (fast or standard mode) and its TX DMA channel with their interrupts.
+ */
+void i2c_bus_init(void);
+
+/**
+ * @brief Aborts the transaction in flight if it overran its deadline.
+ *
+ * Called every millisecond from the SysTick interrupt. An aborted transaction is
+ * followed by a bus recovery and reported to its callback as `I2C_BUS_TIMEOUT`.
+ */
+void i2c_bus_poll(void);
+
+/**
+ * @brief Frees the bus and reinitialises the peripheral.
+ *
+ * With the pins as open-drain outputs, clocks SCL up to `I2C_BUS_RECOVERY_PULSES`
+ * times until the slave releases SDA, sends a stop condition, then resets I2C1 and
+ * restores its configuration. Blocks for about 100 us.
+ */
+void i2c_bus_recover(void);
+
+/**
+ * @brief Returns the error counters.
+ *
+ * @return Counters since start-up.
+ */
+i2c_bus_stats_t i2c_bus_get_stats(void);
+
+/**
+ * @brief Starts a write transaction.
+ *
+ * The data must stay valid until the callback runs.
+ *
+ * @param address 7-bit slave address.
+ * @param data Bytes to write.
+ * @param length Number of bytes (at least one).
+ * @param done Called when the transaction ends; may start the next one.
+ * @return 1 if the transaction was started, 0 if the bus is busy.
+ */
+uint8_t i2c_bus_write(uint8_t address, const uint8_t *data, uint8_t length, i2c_bus_callback_t done);
+
+/**
+ * @brief Starts a single-byte read transaction, as used for a status read.
+ *
+ * Only `length == 1` is supported: longer reads need the F1 POS (two bytes) and BTF
+ * (three or more) ACK/STOP sequences, which are not implemented. The buffer must stay
+ * valid until the callback runs.
+ *
+ * @param address 7-bit slave address.
+ * @param data Destination of the byte read.
+ * @param length Number of bytes; must be 1.
+ * @param done Called when the transaction ends; may start the next one.
+ * @return 1 if the transaction was started, 0 if the bus is busy or `length` is not 1.
+ */
+uint8_t i2c_bus_read(uint8_t address, uint8_t *data, uint8_t length, i2c_bus_callback_t done);
+
+/**
+ * @brief Tells whether a transaction is in flight.
+ *
+ * @return Non-zero while busy.
+ */
+uint8_t i2c_bus_busy(void);
+
+#endif
@@ -1,25 +1,43 @@
 /**
  * @file lcd.h
- * @brief LCD driver using STM32 microcontroller and I2C expander PCF8574 for a 16x4 LCD.
+ * @brief LCD driver using STM32 microcontroller and I2C expander PCF8574 for a 16x4 or 20x4 LCD.
  *
- * This file contains functions to initialize and control a 16x4 LCD
+ * This file contains functions to initialize and control a 16x4 or 20x4 LCD
  * via I2C protocol, using an STM32 microcontroller and a PCF8574 as an I2C expander.
+ * It also provides the HD44780 backends of the display layer (`display.h`).
+ *
+ * The driver is asynchronous: the print, cursor and clear functions only append
+ * operations to a queue and return. The queue is drained from interrupts: consecutive
+ * operations are packed into one `i2c_bus_write()` transaction, four expander bytes
+ * per character, and its completion arms a Timer 4 one-pulse wait after which the
+ * next transaction starts.
+ *
+ * Commands slower than `LCD_BUSY_POLL_MIN_US` (clear, return home) are not given
+ * their datasheet worst case: the busy flag is read back through the expander until
+ * the controller is ready. Reading takes R/W high with the data nibble released, an
+ * EN pulse per nibble and an `i2c_bus_read()` of the expander port while EN is high.
+ * If reads fail or the busy flag never clears (R/W not wired on the backpack), the
+ * driver falls back to the timed waits.
  */
 
+#ifndef LCD_H
+#define LCD_H
+
 #include "libopencm3/stm32/gpio.h"
 #include "libopencm3/stm32/i2c.h"
 #include "libopencm3/stm32/rcc.h"
+#include "libopencm3/stm32/timer.h"
 #include "libopencm3/cm3/systick.h"
+#include "libopencm3/cm3/nvic.h"
+#include "libopencm3/cm3/cortex.h"
+#include "libopencm3/cm3/sync.h"
+#include "i2c_bus.h"
+#include "timebase.h"
+#include "display.h"
 
 /** I2C address of the PCF8574. */
 #define PCF8574_ADDRESS 0x27
 
-/** STM32 SDA pin. */
-#define SDA_PIN GPIO7
-
-/** STM32 SCL pin. */
-#define SCL_PIN GPIO6
-
 // LCD Commands
 /** Command to clear the LCD screen. */
 #define LCD_CLEARDISPLAY 0x01
@@ -36,6 +54,9 @@
 /** Command to set LCD function parameters. */
 #define LCD_FUNCTIONSET 0x20
 
+/** Command to set CGRAM address. */
+#define LCD_SETCGRAMADDR 0x40
+
 /** Command to set DDRAM address. */
 #define LCD_SETDDRAMADDR 0x80
 
@@ -76,9 +97,110 @@
 /** Register select bit. */
 #define LCD_RS 0B00000001
 
+/** Read/write bit (high: the LCD drives the data lines while EN is high). */
+#define LCD_RW 0B00000010
+
+/** Busy flag: D7 of the high nibble read back through the expander. */
+#define LCD_BUSY_FLAG 0x80
+
+/** Number of rows of the display. */
+#define LCD_ROWS 4
+
+/** Most columns of a supported module (20x4). */
+#define LCD_MAX_COLS 20
+
+/** Operation flag: send only the high nibble (4-bit mode initialisation). */
+#define LCD_OP_NIBBLE 0x80
+
+/** Operation flag: send nothing, only wait. */
+#define LCD_OP_WAIT 0x40
+
+/** Number of queued operations (a full 20x4 screen with its cursor moves is 84). */
+#define LCD_QUEUE_SIZE 128
+
+/** Timer pacing the waits between expander writes. */
+#define LCD_WAIT_TIMER TIM4
+
+/** Prescaler of `LCD_WAIT_TIMER`: 72 MHz / 72 = 1 [us] per tick. */
+#define LCD_WAIT_PRESCALER 72
+
+// HD44780 timings (datasheet, fosc = 270 kHz)
+/** Execution time of most commands and of a DDRAM/CGRAM write, in microseconds. */
+#define LCD_T_EXEC_US 37
+
+/** Address counter update after a DDRAM/CGRAM write (tADD), in microseconds. */
+#define LCD_T_ADD_US 4
+
+/** Execution time of clear display and return home, in microseconds. */
+#define LCD_T_CLEAR_US 1520
+
+/** Wait after the first 4-bit initialisation nibble, in microseconds. */
+#define LCD_T_INIT1_US 4100
+
+/** Wait after the second 4-bit initialisation nibble, in microseconds. */
+#define LCD_T_INIT2_US 100
+
+/** Wait after power-on before the first command, in microseconds (40 ms after VCC reaches 4.5 V, plus the supply ramp). */
+#define LCD_T_POWER_ON_US 50000
+
+/**
+ * Longest wait that the next packed character covers by itself, in microseconds.
+ *
+ * A character is four expander bytes, about 90 [us] of bus time at 400 kHz and 360 [us]
+ * at 100 kHz, so operations needing less than this are sent back to back in one
+ * transaction.
+ */
+#define LCD_BATCH_COVER_US 80
+
+/** Operations packed into one transaction at most (a full row with its address). */
+#define LCD_BATCH_OPS (LCD_MAX_COLS + 1)
+
+/** Non-zero to poll the busy flag after slow commands instead of waiting their worst case. */
+#ifndef LCD_BUSY_POLL
+#define LCD_BUSY_POLL 1
+#endif
+
+/**
+ * Shortest wait replaced by busy flag polling, in microseconds.
+ *
+ * A poll is three transactions (strobe, read, release), about 200 [us] of bus time at
+ * 400 kHz, so the 37 [us] waits stay timed and only clear and return home are polled.
+ */
+#define LCD_BUSY_POLL_MIN_US 300
+
+/** Wait before polling again a controller found busy, in microseconds. */
+#define LCD_BUSY_POLL_INTERVAL_US 100
+
+/** A poll still busy after this many times the timed wait is a failed read. */
+#define LCD_BUSY_POLL_TIMEOUT_FACTOR 2
+
+/** Consecutive failed polls after which the driver keeps to timed waits. */
+#define LCD_BUSY_POLL_MAX_FAILURES 3
+
+/** Wait before the next transaction after a failed one, in microseconds. */
+#define LCD_ERROR_BACKOFF_US 20000
+
+/** Expander bytes per packed character (EN high and low for each nibble). */
+#define LCD_BYTES_PER_OP 4
+
+
 /*Frequency of Systick in Hz (1mS)*/
 #define SYSTICK_FREQUENCY 1000
 
+/** Milliseconds elapsed since `systick_setup()`, incremented by `sys_tick_handler()`. */
+extern volatile uint32_t sys_milis;
+
+/**
+ * @brief Busy flag polling counters since start-up.
+ */
+typedef struct {
+    uint32_t polls;      /**< Busy flag reads. */
+    uint32_t early;      /**< Waits ended by the busy flag. */
+    uint32_t saved_us;   /**< Time saved on the timed waits, in microseconds. */
+    uint32_t fallbacks;  /**< Waits that fell back to their timed worst case. */
+    uint8_t active;      /**< Non-zero while polling is in use. */
+} lcd_busy_stats_t;
+
 
 
 
@@ -88,41 +210,46 @@
  *
  * Configures the LCD for 4-bit mode, multi-line display (required for 16x4),
  * and enables the backlight if required. It also sets up the peripheral clock,
- * I2C setup, and any other initial settings required for normal operation.
+ * I2C setup, the wait timer, and any other initial settings required for normal
+ * operation. Nothing blocks: the power-on wait and the initialisation sequence are
+ * queued like any other operation.
  */
 void lcd_init(void);
 
 /**
- * @brief Sends a pulse to enable the LCD.
+ * @brief Queues a nibble (4 bits) of data or command to the LCD.
  *
- * This function sets the enable bit (EN) to latch the data or command
- * currently being sent to the LCD.
+ * This function queues the higher nibble of a byte in 4-bit mode,
+ * typically used for initializing the LCD.
  *
- * @param data Data to send along with the enable pulse.
+ * @param nibble 4-bit data to send (upper nibble).
+ * @param mode Mode for the data (0 for command, `LCD_RS` for data).
+ * @param wait_us Wait after the nibble, in microseconds.
+ * @return 1 if queued, 0 if the queue is full.
  */
-void lcd_pulse_enable(uint8_t data);
+uint8_t lcd_send_nibble(uint8_t nibble, uint8_t mode, uint16_t wait_us);
 
 /**
- * @brief Sends a nibble (4 bits) of data or command to the LCD.
+ * @brief Queues a full byte of data or command to the LCD.
  *
- * This function sends the higher nibble of a byte in 4-bit mode
- * to the LCD, typically used for initializing or sending data or commands.
+ * The byte goes out as two nibbles in 4-bit mode, followed by the execution time of
+ * the command (`lcd_command_wait_us()`).
+ * It is used to send either data or commands, based on the mode parameter.
  *
- * @param nibble 4-bit data to send.
- * @param mode Mode for the data (0 for command, 1 for data).
+ * @param byte 8-bit data to send.
+ * @param mode Mode for the data (0 for command, `LCD_RS` for data).
+ * @return 1 if queued, 0 if the queue is full.
  */
-void lcd_send_nibble(uint8_t nibble, uint8_t mode);
+uint8_t lcd_send_byte(uint8_t byte, uint8_t mode);
 
 /**
- * @brief Sends a full byte of data or command to the LCD.
- *
- * This function sends both nibbles of a byte to the LCD in 4-bit mode.
- * It is used to send either data or commands, based on the mode parameter.
+ * @brief Minimum wait after a transfer, from the HD44780 datasheet.
  *
- * @param byte 8-bit data to send.
- * @param mode Mode for the data (0 for command, 1 for data).
+ * @param byte Command or character.
+ * @param mode 0 for a command, `LCD_RS` for data.
+ * @return Wait in microseconds.
  */
-void lcd_send_byte(uint8_t byte, uint8_t mode);
+uint16_t lcd_command_wait_us(uint8_t byte, uint8_t mode);
 
 /**
  * @brief Prints a single character on the LCD.
@@ -137,8 +264,9 @@ void lcd_print_char(char c);
 /**
  * @brief Prints a string on the LCD.
  *
- * This function sends a null-terminated string to the LCD, printing
- * it starting from the current cursor position.
+ * This function queues a null-terminated string, printed
+ * starting from the current cursor position. The string is queued whole or, if
+ * the queue lacks room for it, dropped whole.
  *
  * @param str Pointer to the null-terminated string to print.
  */
@@ -155,26 +283,48 @@ void lcd_clear(void);
 /**
  * @brief Sets the cursor to a specific position on the LCD.
  *
- * This function moves the cursor to a specified row and column
- * on a 16x4 LCD display.
+ * This function moves the cursor to a specified row and column, using the
+ * row addresses of the module selected by the display backend (16x4 or 20x4).
  *
  * @param row The row number (0 for the first row, 1 for the second row,
  *            2 for the third row, and 3 for the fourth row).
- * @param col The column number (0 to 15 for a 16x4 LCD).
+ * @param col The column number (0 to 15 for a 16x4 LCD, 0 to 19 for a 20x4 LCD).
  */
 void lcd_set_cursor(uint8_t row, uint8_t col);
 
 /**
- * @brief Block for a specified number of milliseconds.
- * 
- * This function uses the global millisecond counter `system_millis` to
- * implement a blocking delay. The function returns once the specified
- * amount of time has elapsed.
- * 
- * @param ms The delay duration in milliseconds.
+ * @brief Tells whether every queued operation has been sent.
+ *
+ * @return Non-zero when the queue is empty and the bus idle.
+ */
+uint8_t lcd_is_idle(void);
+
+/**
+ * @brief Free slots in the operation queue.
+ *
+ * @return Operations that can still be queued.
  */
-void delay_ms(uint32_t ms);
+uint16_t lcd_queue_free(void);
 
+/**
+ * @brief Operations dropped because the queue was full.
+ *
+ * @return Counter since start-up.
+ */
+uint32_t lcd_get_overflows(void);
+
+/**
+ * @brief Returns the busy flag polling counters.
+ *
+ * @return Counters since start-up.
+ */
+lcd_busy_stats_t lcd_get_busy_stats(void);
+
+/** Display backend for a 16x4 module (rows at 0x00, 0x40, 0x10, 0x50). */
+extern const display_driver_t lcd_display_16x4;
+
+/** Display backend for a 20x4 module (rows at 0x00, 0x40, 0x14, 0x54). */
+extern const display_driver_t lcd_display_20x4;
 
 /**
  * @brief Configure the SysTick timer to generate interrupts every 1 ms.
@@ -192,6 +342,8 @@ void systick_setup(void);
  * 
  * This function is called every time the SysTick timer generates an interrupt,
  * which occurs at a rate defined by `SYSTICK_FREQUENCY`. It increments the
- * global millisecond counter `system_millis`.
+ * global millisecond counter `system_millis` and checks the I2C transaction deadline.
  */
-void sys_tick_handler(void);
\ No newline at end of file
+void sys_tick_handler(void);
+
+#endif
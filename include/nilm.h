@@ -0,0 +1,131 @@
+/**
+ * @file nilm.h
+ * @brief Appliance event detection (NILM-lite) from step changes in active and reactive power.
+ *
+ * Every cycle the detector looks for a new steady state of P and Q. When it differs from
+ * the previous one by more than `NILM_STEP_THRESHOLD_W`, the step (dP, dQ) is an event:
+ * positive steps are clustered into learned appliance classes and switch that class on,
+ * negative steps switch off the running class with the closest signature. While a class is
+ * on, its signature power is attributed to its energy register.
+ *
+ * All state lives in fixed tables (well under 1 KB) and the learned signatures are kept in
+ * the last flash page so they survive a reset.
+ */
+
+#ifndef NILM_H
+#define NILM_H
+
+#include <stdint.h>
+
+/** @brief Maximum number of learned appliance classes. */
+#define NILM_MAX_CLASSES 16
+
+/** @brief Number of cycles a steady state must last before it is accepted. */
+#define NILM_WINDOW_CYCLES 8
+
+/** @brief Maximum P spread (W) inside the window for it to count as steady. */
+#define NILM_STEADY_BAND_W 10.0f
+
+/** @brief Minimum |dP| (W) between steady states to report an event. */
+#define NILM_STEP_THRESHOLD_W 30.0f
+
+/** @brief Absolute signature match tolerance in W/var. */
+#define NILM_MATCH_ABS_W 20.0f
+
+/** @brief Relative signature match tolerance (fraction of the class signature). */
+#define NILM_MATCH_REL 0.15f
+
+/** @brief Matches after which a class centroid stops moving quickly. */
+#define NILM_LEARN_CAP 32
+
+/** @brief Minimum seconds between two flash writes of the learned table. */
+#define NILM_SAVE_INTERVAL_S 3600
+
+/** @brief Address of the flash page holding the learned table (last 1 KB page, kept out of the link by stm32f103c8_nilm.ld). */
+#define NILM_FLASH_PAGE_ADDR 0x0800FC00UL
+
+/** @brief Marker identifying a valid learned table in flash. */
+#define NILM_FLASH_MAGIC 0x4E494C31UL
+
+/**
+ * @brief Learned appliance class.
+ */
+typedef struct {
+    float delta_p_w;    /**< Signature active power step in W. */
+    float delta_q_var;  /**< Signature reactive power step in var. */
+    uint16_t matches;   /**< Number of ON events matched to the class. */
+    uint8_t on;         /**< Non-zero while the appliance is believed to be running. */
+} nilm_class_t;
+
+/**
+ * @brief Clears the detector and loads the learned classes from flash.
+ */
+void nilm_init(void);
+
+/**
+ * @brief Runs the detector on the active and reactive power of one cycle.
+ *
+ * Bounded time: O(`NILM_WINDOW_CYCLES` + `NILM_MAX_CLASSES`).
+ *
+ * @param p_w Active power of the cycle in W.
+ * @param q_var Reactive power of the cycle in var.
+ */
+void nilm_process_cycle(float p_w, float q_var);
+
+/**
+ * @brief Attributes one second of energy to the running classes.
+ */
+void nilm_tick_second(void);
+
+/**
+ * @brief Returns the number of learned classes.
+ *
+ * @return Number of valid entries in the class table.
+ */
+uint8_t nilm_get_class_count(void);
+
+/**
+ * @brief Returns a learned class.
+ *
+ * @param index Class index (0 to `nilm_get_class_count()` - 1).
+ * @return Class signature and state.
+ */
+nilm_class_t nilm_get_class(uint8_t index);
+
+/**
+ * @brief Returns the energy attributed to a class since start-up.
+ *
+ * @param index Class index.
+ * @return Energy in kWh.
+ */
+float nilm_get_class_kwh(uint8_t index);
+
+/**
+ * @brief Returns the number of step events detected since start-up.
+ *
+ * @return Event count.
+ */
+uint32_t nilm_get_event_count(void);
+
+/**
+ * @brief Writes the learned table to flash if it changed since the last save.
+ */
+void nilm_save(void);
+
+/**
+ * @brief Saves the learned table once `NILM_SAVE_INTERVAL_S` elapsed since the last save.
+ *
+ * Erasing the flash page stalls every fetch from flash for 20 to 40 ms: the metering
+ * task and the interrupts, ADC included, wait until the erase ends. Running this from
+ * the low-priority logging task does not avoid that stall, it only keeps saves rare
+ * (at most one per `NILM_SAVE_INTERVAL_S`). An ADC block overwritten meanwhile is
+ * dropped and counted by `adc_get_lost_blocks()`.
+ */
+void nilm_save_poll(void);
+
+/**
+ * @brief Forgets every learned class (in RAM and in flash).
+ */
+void nilm_forget(void);
+
+#endif
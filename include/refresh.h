@@ -8,8 +8,14 @@
 #include "libopencm3/cm3/nvic.h"
 #include "adc_dma.h"
 #include "lcd.h"
-#include "stdio.h"
 #include "timer_exti.h"
+#include "demand.h"
+#include "tariff.h"
+#include "stats.h"
+#include "nilm.h"
+#include "ui.h"
+#include "sched.h"
+#include "rtc_clock.h"
 #include <stdint.h>
 
 
@@ -25,6 +31,21 @@
 /** @brief False valor declaration. */
 #define FALSE 0
 
+/** @brief Length of one meter second in SysTick milliseconds. */
+#define METER_SECOND_MS 1000
+
+/** @brief Energy of one ADC block per watt of active power, in mWs (20 mWs for a 20 ms block). */
+#define METER_BLOCK_MWS_PER_W ((float)DEMAND_MWS_PER_WS * ADC_SAMPLE_COUNT / ADC_SAMPLE_RATE_HZ)
+
+/** @brief Deadline of the metering and protection tasks: one ADC block, before its half of the buffer is overwritten. */
+#define TASK_BLOCK_DEADLINE_MS (1000 * ADC_SAMPLE_COUNT / ADC_SAMPLE_RATE_HZ)
+
+/** @brief Period of the display task: samples the page button three times per debounce time. */
+#define TASK_DISPLAY_PERIOD_MS (UI_DEBOUNCE_MS / 3)
+
+/** @brief Period of the logging task. */
+#define TASK_LOGGING_PERIOD_MS 1000
+
 
 
 
@@ -45,47 +66,142 @@ void set_pwm_duty_cycle(uint16_t duty);
  */
 void pwm_implementation(void);
 
+/**
+ * @brief Latest metering results, refreshed once per ADC block.
+ */
+typedef struct {
+    float voltage;       /**< RMS voltage in V. */
+    float current;       /**< RMS current in A. */
+    float power;         /**< Active power in W. */
+    float phase;         /**< Filtered phase angle in degrees (positive: current lagging). */
+    float power_factor;  /**< Displacement power factor. */
+    float frequency;     /**< Mains frequency in Hz. */
+    uint32_t block;      /**< ADC block the results were computed from. */
+} metering_snapshot_t;
+
+/**
+ * @brief Advances the meter clock and feeds the per-second energy registers.
+ *
+ * Run by the metering task, released by every completed ADC block (one mains
+ * cycle), so the metering cadence follows the acquisition; a call without a new block
+ * does nothing. For each whole second elapsed since the previous block, the
+ * energy of that second is integrated from the present power and pushed to the demand
+ * and tariff modules, so a slow pass never loses meter seconds. Voltage, current,
+ * power and phase are also sampled into the statistics engine, and the active and
+ * reactive power of every block are fed to the appliance event detector.
+ */
+void metering_poll(void);
+
+/**
+ * @brief Returns the results of the last processed ADC block.
+ *
+ * Written and read at task level only, so a plain copy is consistent.
+ *
+ * @return Latest metering results.
+ */
+metering_snapshot_t metering_get_snapshot(void);
 
 /**
- * @brief Update and display the sensor values and calculated variables on an LCD screen.
- * This function retrieves sensor values for voltage and current, calculates the power, 
- * and displays these values along with the phase shift on a 4-line LCD. The values are
- * formatted as strings for better readability. 
+ * @brief Returns the meter clock.
+ *
+ * @return Seconds counted by `metering_poll()` since start-up.
  */
-void update_values(void);
+uint32_t metering_get_seconds(void);
 
+/**
+ * @brief Starts the wall clock and the first billing period.
+ *
+ * Must be called after `tariff_init()` and `demand_init()`.
+ */
+void metering_init(void);
 
+/**
+ * @brief Sets the wall-clock time of day.
+ *
+ * The time is kept by the battery-backed RTC (`rtc_clock.h`), so it survives resets.
+ *
+ * @param seconds_of_day Current time in seconds since midnight.
+ */
+void metering_set_time_of_day(uint32_t seconds_of_day);
 
 /**
- * @brief Reads the sensor data from the ADC buffer and calculates the average values.
+ * @brief Returns the wall-clock time of day used to select the tariff band.
  *
- * This function reads the sensor data from the ADC buffer and calculates the average
- * values for the voltage and current sensors based on the collected samples. It processes
- * the ADC data to obtain the sensor readings in the desired units (e.g., voltage in V,
- * current in A) and returns the calculated values for further processing or display.
- * 
- * The function should be called after the ADC samples have been collected and stored in
- * the buffer. It processes the data to obtain the sensor readings and returns the calculated
- * values for use in the application logic.
- * 
- * @return An array of floating-point values containing the average sensor readings.
+ * @return Seconds since midnight.
  */
+uint32_t metering_get_time_of_day(void);
 
+/**
+ * @brief Starts a new billing period (tariff registers and peak demand are cleared).
+ *
+ * Called by `metering_poll()` at the first midnight `tariff_get_billing_days()` days
+ * after the period started; can also be called to close the period early.
+ */
+void metering_new_billing_period(void);
+
+
+
+/**
+ * @brief Reads the sensor data from the ADC buffer and calculates the RMS value.
+ *
+ * Processes the last completed ADC block (one mains cycle) of a channel: the DC bias of
+ * the sensor, as tracked by the zero-crossing detector, is removed from every sample
+ * and the RMS of the remaining AC signal is converted to the channel's unit (voltage in
+ * V, current in A).
+ *
+ * @param channel `0` for voltage, `1` for current.
+ * @return RMS value of the cycle, or 0 for an invalid channel.
+ */
 float get_sensor_values(uint8_t channel);
 
+/**
+ * @brief Calculates the active power of the last ADC block.
+ *
+ * @return Mean of the bias-removed voltage and current products over the cycle, in W.
+ */
+float get_active_power(void);
+
+/**
+ * @brief Waveform shape metrics of one channel.
+ *
+ * All of them are taken on the AC signal, after removing the DC bias of the sensor. A
+ * crest factor well below sqrt(2) means clipping (e.g. CT saturation); a high one means
+ * a peaky, distorted waveform. A sine has a form factor of about 1.11.
+ */
+typedef struct {
+    float peak;               /**< Largest distance from the bias in the cycle (V or A). */
+    float rms;                /**< RMS value of the cycle (V or A). */
+    float crest_factor;       /**< Peak / RMS of the cycle. */
+    float form_factor;        /**< RMS / rectified mean of the cycle. */
+    float peak_hold;          /**< Highest peak since the last reset. */
+    float crest_factor_hold;  /**< Highest crest factor since the last reset. */
+} waveform_metrics_t;
 
+/**
+ * @brief Returns the peak, crest factor and form factor of a channel.
+ *
+ * The values are refreshed by `get_sensor_values()` in the same sample loop that
+ * computes the RMS.
+ *
+ * @param channel `0` for voltage, `1` for current.
+ * @return Waveform metrics of the last cycle and the max-hold registers.
+ */
+waveform_metrics_t get_waveform_metrics(uint8_t channel);
 
 /**
- * @brief average of the stored phase shift values
- * This function iterates through the phase shift buffer and calculates the average of these values.
- * 
- * @return An average of the values stored in the buffer.
+ * @brief Clears the max-hold registers of a channel.
+ *
+ * @param channel `0` for voltage, `1` for current.
  */
-float average_phase_shift(void);
+void reset_waveform_hold(uint8_t channel);
+
+
+
 
 
 /**
  * @brief Led brightness
  * This function adjusts the LED brightness based on critical consumption values, using the PWM module for this purpose.
+ * Run by the protection task after each ADC block.
  */
 void adjust_led_intensity(void);
@@ -0,0 +1,54 @@
+/**
+ * @file rtc_clock.h
+ * @brief Battery-backed wall clock on the STM32F1 RTC.
+ *
+ * The RTC counts seconds from the 32.768 kHz LSE crystal in the backup domain, so it
+ * keeps running through resets and, with a battery on VBAT, through power cuts. The
+ * counter holds the days since the clock was first set times `SECONDS_PER_DAY` plus
+ * the time of day; only the time of day and the day number are used.
+ *
+ * On a first start (backup domain empty) the clock is seeded with the time of day the
+ * firmware was built at, which is close enough right after flashing; it can be set
+ * precisely with `rtc_clock_set_time_of_day()`.
+ */
+
+#ifndef RTC_CLOCK_H
+#define RTC_CLOCK_H
+
+#include <stdint.h>
+#include "libopencm3/stm32/rcc.h"
+#include "libopencm3/stm32/rtc.h"
+#include "tariff.h"
+
+/** @brief RTC prescaler for one count per second from the 32.768 kHz LSE. */
+#define RTC_CLOCK_PRESCALER 0x7FFF
+
+/**
+ * @brief Starts the RTC, or resumes it if it kept running in the backup domain.
+ *
+ * A first start waits for the LSE crystal, which can take a second or two.
+ */
+void rtc_clock_init(void);
+
+/**
+ * @brief Returns the wall-clock time of day.
+ *
+ * @return Seconds since midnight.
+ */
+uint32_t rtc_clock_get_time_of_day(void);
+
+/**
+ * @brief Returns the day number.
+ *
+ * @return Days since the clock was first set.
+ */
+uint32_t rtc_clock_get_day(void);
+
+/**
+ * @brief Sets the time of day, keeping the day number.
+ *
+ * @param seconds_of_day Current time in seconds since midnight.
+ */
+void rtc_clock_set_time_of_day(uint32_t seconds_of_day);
+
+#endif
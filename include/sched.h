@@ -0,0 +1,128 @@
+/**
+ * @file sched.h
+ * @brief Event-driven cooperative run-to-completion scheduler.
+ *
+ * The application is a static table of tasks. A task is released periodically, by
+ * events posted from interrupts, or both, and runs to completion when dispatched:
+ * tasks never preempt each other, only interrupts preempt them. Among the released
+ * tasks the dispatcher runs the one of highest priority (lowest number), the earliest
+ * deadline first between equal priorities, then looks again, so a slow task delays the
+ * others by at most its own run and never holds back the acquisition.
+ *
+ * Each task counts its runs, its longest run and the runs that ended after their
+ * deadline, measured from the release.
+ *
+ * When no task is released the core sleeps (WFI) until the next interrupt: an ADC
+ * block from the DMA, the button EXTI, an I2C transfer or the 1 ms SysTick that paces the
+ * periodic tasks. Only the core clock stops, so acquisition and transfers go on. The
+ * time awake is counted with the DWT cycle counter, which only has to run while the
+ * core does, and reported per `SCHED_LOAD_WINDOW_MS` window as the CPU load.
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+/** @brief Most tasks in a table. */
+#define SCHED_MAX_TASKS 8
+
+/** @brief Non-zero to sleep when idle; zero keeps the core spinning (some debug probes lose a sleeping core). */
+#ifndef SCHED_IDLE_SLEEP
+#define SCHED_IDLE_SLEEP 1
+#endif
+
+/** @brief Window over which the CPU load is measured, in SysTick milliseconds. */
+#define SCHED_LOAD_WINDOW_MS 1000
+
+/** @brief Event: an ADC block is complete (DMA1 channel 1). */
+#define SCHED_EVENT_ADC_BLOCK 0x01
+
+/** @brief Event: the page button changed level (EXTI12). */
+#define SCHED_EVENT_BUTTON 0x02
+
+/** @brief Event: the display backend has room again for cells a flush left behind. */
+#define SCHED_EVENT_I2C 0x04
+
+/** @brief Task entry point. */
+typedef void (*sched_run_t)(void);
+
+/**
+ * @brief One task of the table.
+ */
+typedef struct {
+    const char *name;      /**< Short name, for diagnostics. */
+    sched_run_t run;       /**< Runs the task to completion. */
+    uint16_t period_ms;    /**< Release period; 0 for a task released by events only. */
+    uint16_t deadline_ms;  /**< Time from the release by which a run must end. */
+    uint8_t priority;      /**< 0 is the highest. */
+    uint8_t events;        /**< `SCHED_EVENT_` flags that release the task. */
+} sched_task_t;
+
+/**
+ * @brief Counters of one task since start-up.
+ */
+typedef struct {
+    uint32_t runs;             /**< Completed runs. */
+    uint32_t deadline_misses;  /**< Runs that ended after their deadline, and skipped periods. */
+    uint32_t max_run_us;       /**< Longest run, in microseconds. */
+} sched_task_stats_t;
+
+/**
+ * @brief CPU load of the last complete window.
+ */
+typedef struct {
+    uint16_t load_permille;  /**< Time awake (tasks and interrupts), per mille of the window. */
+    uint16_t peak_permille;  /**< Highest `load_permille` since start-up. */
+    uint32_t busy_us;        /**< Time awake in the window, in microseconds. */
+    uint32_t sleep_us;       /**< Time asleep in the window, in microseconds. */
+    uint32_t sleeps;         /**< Times the core went to sleep since start-up. */
+} sched_load_t;
+
+/**
+ * @brief Installs the task table; periodic tasks are first released one period later.
+ *
+ * Interrupts posting events may run before this: their events are ignored.
+ *
+ * @param tasks Task table (kept, not copied).
+ * @param count Number of tasks (at most `SCHED_MAX_TASKS`).
+ */
+void sched_init(const sched_task_t *tasks, uint8_t count);
+
+/**
+ * @brief Releases every task waiting for one of the events.
+ *
+ * Safe from any interrupt. A task already released keeps its first release time.
+ *
+ * @param events `SCHED_EVENT_` flags.
+ */
+void sched_post(uint8_t events);
+
+/**
+ * @brief Runs the released task of highest priority, if any.
+ *
+ * @return 1 if a task ran, 0 if none was released.
+ */
+uint8_t sched_dispatch(void);
+
+/**
+ * @brief Dispatches tasks forever, sleeping whenever none is released.
+ */
+void sched_run(void);
+
+/**
+ * @brief Returns the CPU load measured over the last complete window.
+ *
+ * @return Load and sleep figures.
+ */
+sched_load_t sched_get_load(void);
+
+/**
+ * @brief Returns the counters of a task.
+ *
+ * @param task Index in the table.
+ * @return Counters since start-up (zero for an invalid index).
+ */
+sched_task_stats_t sched_get_stats(uint8_t task);
+
+#endif
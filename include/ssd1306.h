@@ -0,0 +1,61 @@
+/**
+ * @file ssd1306.h
+ * @brief SSD1306 128x64 OLED display backend.
+ *
+ * The OLED is driven as a 21x8 character display with a 5x7 font in 6x8 pixel cells,
+ * so the UI is the same as on the LCD. Text runs are rendered into a RAM copy of the
+ * display, organised as the controller's eight 128-byte pages. Only the pages that
+ * changed are pushed, each as one addressing command and one 129-byte data
+ * transaction sent by DMA (`i2c_bus.h`), chained from the I2C completion interrupt.
+ *
+ * The eight user-defined glyphs of the display layer are kept in RAM and drawn like
+ * any other character; redefining one redraws the cells that show it.
+ */
+
+#ifndef SSD1306_H
+#define SSD1306_H
+
+#include <stdint.h>
+#include "display.h"
+#include "i2c_bus.h"
+#include "timebase.h"
+#include "libopencm3/cm3/cortex.h"
+
+/** @brief 7-bit I2C address of the SSD1306 (SA0 low). */
+#define SSD1306_ADDRESS 0x3C
+
+/** @brief Width in pixels. */
+#define SSD1306_WIDTH 128
+
+/** @brief Pages of 8 pixel rows. */
+#define SSD1306_PAGES 8
+
+/** @brief Pixel columns per character cell (5 of glyph, 1 of spacing). */
+#define SSD1306_CELL_WIDTH 6
+
+/** @brief Pixel columns of a glyph. */
+#define SSD1306_GLYPH_WIDTH 5
+
+/** @brief Character columns. */
+#define SSD1306_COLS (SSD1306_WIDTH / SSD1306_CELL_WIDTH)
+
+/** @brief Character rows (one per page). */
+#define SSD1306_ROWS SSD1306_PAGES
+
+/** @brief Control byte: the following bytes are commands. */
+#define SSD1306_CONTROL_COMMAND 0x00
+
+/** @brief Control byte: the following bytes are display data. */
+#define SSD1306_CONTROL_DATA 0x40
+
+/** @brief SSD1306 display backend. */
+extern const display_driver_t ssd1306_display;
+
+/**
+ * @brief Pages pushed to the display since start-up.
+ *
+ * @return Counter.
+ */
+uint32_t ssd1306_get_page_writes(void);
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * @file stats.h
+ * @brief Constant-memory streaming statistics of the measured quantities.
+ *
+ * For each quantity the module tracks min, max, mean and variance (Welford) and
+ * approximate P50/P95/P99 quantiles with the P² algorithm, which keeps five markers per
+ * quantile instead of the samples themselves. At the end of every period the results
+ * are published and the accumulators restart, so a reader always gets a complete set
+ * from the last period without stopping acquisition.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/** @brief Default statistics period in seconds. */
+#define STATS_DEFAULT_PERIOD_S 60
+
+/** @brief Number of markers used by each P² quantile estimator. */
+#define STATS_P2_MARKERS 5
+
+/**
+ * @brief Quantities tracked by the statistics engine.
+ */
+typedef enum {
+    STATS_VOLTAGE,        /**< Voltage in V. */
+    STATS_CURRENT,        /**< Current in A. */
+    STATS_POWER,          /**< Power in W. */
+    STATS_PHASE,          /**< Signed phase angle in degrees. */
+    STATS_QUANTITY_COUNT  /**< Number of tracked quantities. */
+} stats_quantity_t;
+
+/**
+ * @brief Statistics of one quantity over one period.
+ */
+typedef struct {
+    uint32_t count;  /**< Number of samples in the period. */
+    float min;       /**< Minimum value. */
+    float max;       /**< Maximum value. */
+    float mean;      /**< Arithmetic mean. */
+    float variance;  /**< Population variance. */
+    float p50;       /**< Approximate median. */
+    float p95;       /**< Approximate 95th percentile. */
+    float p99;       /**< Approximate 99th percentile. */
+} stats_result_t;
+
+/**
+ * @brief Clears every accumulator and published result and sets the period.
+ *
+ * @param period_s Statistics period in seconds (0 selects `STATS_DEFAULT_PERIOD_S`).
+ */
+void stats_init(uint32_t period_s);
+
+/**
+ * @brief Changes the period; the current one restarts with the new length.
+ *
+ * @param period_s Statistics period in seconds (0 selects `STATS_DEFAULT_PERIOD_S`).
+ */
+void stats_set_period(uint32_t period_s);
+
+/**
+ * @brief Adds a sample of a quantity to the current period.
+ *
+ * @param quantity Quantity the sample belongs to.
+ * @param value Sample value.
+ */
+void stats_update(stats_quantity_t quantity, float value);
+
+/**
+ * @brief Advances the period by one meter second and publishes the results when it ends.
+ */
+void stats_tick_second(void);
+
+/**
+ * @brief Returns the statistics of the last completed period.
+ *
+ * @param quantity Quantity to read.
+ * @return Published statistics (all zero before the first period ends).
+ */
+stats_result_t stats_get_result(stats_quantity_t quantity);
+
+/**
+ * @brief Returns the statistics of the period in progress.
+ *
+ * @param quantity Quantity to read.
+ * @return Statistics accumulated so far in the current period.
+ */
+stats_result_t stats_get_running(stats_quantity_t quantity);
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * @file tariff.h
+ * @brief Time-of-use tariff registers and running cost estimation.
+ *
+ * The day is divided into fixed slots and each slot is mapped to a tariff band when
+ * the schedule is configured. Integrated energy is then routed to the band of the
+ * current slot with a single table lookup, and the running cost and projected bill
+ * are derived from the per-band energy registers.
+ */
+
+#ifndef TARIFF_H
+#define TARIFF_H
+
+#include <stdint.h>
+
+/** @brief Maximum number of tariff bands. */
+#define TARIFF_MAX_BANDS 4
+
+/** @brief Length of one schedule slot in seconds (15 minutes). */
+#define TARIFF_SLOT_S 900
+
+/** @brief Number of seconds in a day. */
+#define SECONDS_PER_DAY 86400UL
+
+/** @brief Number of schedule slots in a day. */
+#define TARIFF_SLOTS_PER_DAY (SECONDS_PER_DAY / TARIFF_SLOT_S)
+
+/** @brief Milliwatt-seconds in one kWh. */
+#define TARIFF_MWS_PER_KWH 3600000000.0f
+
+/** @brief Default billing period length in days. */
+#define TARIFF_DEFAULT_BILLING_DAYS 30
+
+/** @brief Default band for slots not covered by the schedule. */
+#define TARIFF_BAND_REST 0
+
+/** @brief Band used for the night valley hours. */
+#define TARIFF_BAND_VALLEY 1
+
+/** @brief Band used for the evening peak hours. */
+#define TARIFF_BAND_PEAK 2
+
+/** @brief Default price per kWh of the rest band. */
+#define TARIFF_PRICE_REST 1.00f
+
+/** @brief Default price per kWh of the valley band. */
+#define TARIFF_PRICE_VALLEY 0.70f
+
+/** @brief Default price per kWh of the peak band. */
+#define TARIFF_PRICE_PEAK 1.40f
+
+/**
+ * @brief Clears the schedule, the prices and every register.
+ *
+ * After this call the whole day belongs to band 0 and the billing period is
+ * `TARIFF_DEFAULT_BILLING_DAYS` long.
+ */
+void tariff_init(void);
+
+/**
+ * @brief Sets the price of a band.
+ *
+ * @param band Band index (0 to `TARIFF_MAX_BANDS` - 1).
+ * @param price_per_kwh Price of one kWh in the band.
+ */
+void tariff_set_price(uint8_t band, float price_per_kwh);
+
+/**
+ * @brief Assigns a time range of the day to a band.
+ *
+ * The range is rounded to whole slots and precomputed into the slot table. If
+ * `end_min` is not after `start_min` the range wraps over midnight.
+ *
+ * @param start_min Start of the range in minutes since midnight (inclusive).
+ * @param end_min End of the range in minutes since midnight (exclusive).
+ * @param band Band index the range is billed at.
+ */
+void tariff_set_band(uint16_t start_min, uint16_t end_min, uint8_t band);
+
+/**
+ * @brief Sets the billing period length used for the month-end projection.
+ *
+ * @param days Billing period length in days.
+ */
+void tariff_set_billing_days(uint8_t days);
+
+/**
+ * @brief Returns the billing period length.
+ *
+ * @return Billing period length in days.
+ */
+uint8_t tariff_get_billing_days(void);
+
+/**
+ * @brief Routes the energy of one meter second to the band active at that time.
+ *
+ * @param energy_mws Energy of the second in milliwatt-seconds.
+ * @param time_of_day_s Time of day of that second in seconds since midnight.
+ */
+void tariff_push_energy(uint32_t energy_mws, uint32_t time_of_day_s);
+
+/**
+ * @brief Returns the band the last second was billed at.
+ *
+ * @return Active band index.
+ */
+uint8_t tariff_get_active_band(void);
+
+/**
+ * @brief Returns the energy registered in a band during the billing period.
+ *
+ * @param band Band index.
+ * @return Energy in kWh.
+ */
+float tariff_get_band_kwh(uint8_t band);
+
+/**
+ * @brief Returns the energy registered in every band during the billing period.
+ *
+ * @return Energy in kWh.
+ */
+float tariff_get_total_kwh(void);
+
+/**
+ * @brief Returns the running cost of the billing period.
+ *
+ * @return Cost so far, in the currency of the configured prices.
+ */
+float tariff_get_cost(void);
+
+/**
+ * @brief Projects the cost of the whole billing period from the cost so far.
+ *
+ * @return Projected month-end bill, or the running cost if no second has elapsed yet.
+ */
+float tariff_get_projected_cost(void);
+
+/**
+ * @brief Clears the energy registers and starts a new billing period.
+ */
+void tariff_reset_registers(void);
+
+#endif
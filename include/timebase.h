@@ -0,0 +1,68 @@
+/**
+ * @file timebase.h
+ * @brief Microsecond timebase on the Cortex-M3 DWT cycle counter.
+ *
+ * The cycle counter runs at the 72 MHz core clock and wraps every 59.6 s. Deadlines
+ * are cycle counter values compared with a signed difference, so they stay correct
+ * across the wrap for any wait shorter than half of it (29.8 s).
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+#include "libopencm3/cm3/dwt.h"
+
+/** @brief Core clock cycles per microsecond. */
+#define TIMEBASE_CYCLES_PER_US 72U
+
+/** @brief Longest supported wait in microseconds (half the counter range). */
+#define TIMEBASE_MAX_US (0x7FFFFFFFUL / TIMEBASE_CYCLES_PER_US)
+
+/** @brief Cycle counter value at which a wait ends. */
+typedef uint32_t timebase_deadline_t;
+
+/**
+ * @brief Starts the DWT cycle counter.
+ */
+void timebase_init(void);
+
+/**
+ * @brief Returns the cycle counter.
+ *
+ * @return Core clock cycles, modulo 2^32.
+ */
+uint32_t timebase_cycles(void);
+
+/**
+ * @brief Computes the deadline a number of microseconds from now.
+ *
+ * @param us Wait in microseconds (at most `TIMEBASE_MAX_US`).
+ * @return Deadline to pass to `timebase_expired()`.
+ */
+timebase_deadline_t timebase_deadline_us(uint32_t us);
+
+/**
+ * @brief Tells whether a deadline has passed.
+ *
+ * @param deadline Deadline from `timebase_deadline_us()`.
+ * @return Non-zero once the deadline is reached.
+ */
+uint8_t timebase_expired(timebase_deadline_t deadline);
+
+/**
+ * @brief Microseconds elapsed since a cycle counter value.
+ *
+ * @param start Value of `timebase_cycles()` at the start.
+ * @return Elapsed time in microseconds (valid up to 59.6 s).
+ */
+uint32_t timebase_elapsed_us(uint32_t start);
+
+/**
+ * @brief Busy-waits on the cycle counter; for short waits only.
+ *
+ * @param us Wait in microseconds.
+ */
+void delay_us(uint32_t us);
+
+#endif
@@ -2,15 +2,23 @@
  * @file timer_exti.h
  * @brief Phase Shift determination
  * This file provides functions and definitions for initializing Port A pins 
- * as external interrupt inputs, configuring Timer 2, and determining the phase 
+ * as Timer 2 input capture inputs, configuring Timer 2, and determining the phase 
  * shift between two signals. 
  */
 
+#ifndef TIMER_EXTI_H
+#define TIMER_EXTI_H
+
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/timer.h>
 #include <libopencm3/stm32/exti.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/stm32/dma.h>
+#include <math.h>
+#include "zero_cross.h"
 
 /**
  * @brief define the Extern Interruptions Port
@@ -18,37 +26,119 @@
 #define EXTI_PORT   GPIOA
 
 /**
- * @brief define exti pin 
+ * @brief define exti pin (voltage optocoupler, TIM2_CH3)
  */
 #define EXTI_PIN0   GPIO2
 
 /**
- * @brief define exti pin
+ * @brief define exti pin (current optocoupler, TIM2_CH4)
  */
 #define EXTI_PIN1   GPIO3
 
 /**
- * @brief define the square root of two
+ * @brief define the buffer shape shift size
  */
-#define SQRT_2 1.4142
+#define N_PHASE_SHIFT 10
+
+/** @brief Timer 1 prescaler: 72 MHz / 72 = 1 MHz. */
+#define PREESCALER_TM1 72
 
 /**
- * @brief define the buffer shape shift size
+ * @brief Timer 2 prescaler: 72 MHz / 72 = 1 MHz, 1 [us] per tick (0.018 deg at 50 Hz).
+ *
+ * The 16-bit counter wraps every 65.5 [ms], so a modulo-2^16 difference of two
+ * captures is unambiguous over three 50 Hz periods: up to two consecutive missed
+ * edges are still measured as such instead of aliasing to a short interval.
  */
-#define N_PHASE_SHIFT 10
+#define PREESCALER_TM2 72
+
+/** @brief Timer 2 auto-reload value (free-running full range). */
+#define PERIOD_TM2 0xFFFF
+
+/** @brief One full turn (360 deg) in the Q15 phase angle representation. */
+#define PHASE_Q15_TURN 65536.0f
+
+/** @brief Timer 2 tick frequency in Hz. */
+#define TM2_TICK_HZ (72000000UL / PREESCALER_TM2)
 
 /**
- * @brief define half period in [us] of a 50 [Hz] signal
+ * @brief Capture mode selection.
+ *
+ * - `1`: every current edge triggers a TIM2 DMA burst that copies CCR3 and CCR4 into a
+ *   circular buffer; `phase_capture_poll()` consumes the pairs in batches from the main loop.
+ *   No CPU time is spent per edge.
+ * - `0`: both edges raise the Timer 2 interrupt.
  */
-#define HALF_PERIOD 100
+#ifndef PHASE_CAPTURE_DMA
+#define PHASE_CAPTURE_DMA 1
+#endif
 
-#define MS_CONVERSION 10 // conversion de us a mS
+/** @brief Phase filter: circular mean of the last `N_PHASE_SHIFT` samples. */
+#define PHASE_FILTER_MEAN 0
 
-#define PREESCALER_TM1 72
+/** @brief Phase filter: exponential moving average with weight 1/2^`PHASE_EMA_SHIFT`. */
+#define PHASE_FILTER_EMA 1
+
+/** @brief Phase filter: median of the last `N_PHASE_SHIFT` samples. */
+#define PHASE_FILTER_MEDIAN 2
+
+/**
+ * @brief Filter applied to the phase samples, updated on every current edge.
+ *
+ * The median ignores isolated outliers that pass the edge gating; the EMA has the
+ * smoothest output and the smallest state; the mean weighs the whole window equally.
+ */
+#ifndef PHASE_FILTER
+#define PHASE_FILTER PHASE_FILTER_MEDIAN
+#endif
+
+/** @brief EMA weight of a new sample: 1/2^n (n = 3: time constant of about 8 cycles). */
+#define PHASE_EMA_SHIFT 3
+
+/** @brief Shortest accepted mains period in Timer 2 ticks (65 Hz). */
+#define PHASE_PERIOD_MIN ((uint16_t)(TM2_TICK_HZ / 65))
+
+/** @brief Longest accepted mains period in Timer 2 ticks (45 Hz). */
+#define PHASE_PERIOD_MAX ((uint16_t)(TM2_TICK_HZ / 45))
+
+/** @brief Accepted deviation from the tracked period once locked: period / 2^5 (about 3 %). */
+#define PHASE_PERIOD_TOL_SHIFT 5
+
+/** @brief Consecutive resynchronised voltage edges after which the period lock is dropped. */
+#define PHASE_RELOCK_EDGES 4
+
+/**
+ * @brief Input capture digital filter for both optocoupler channels.
+ *
+ * fSAMPLING = 72 MHz / 32 with 8 consecutive samples: pulses shorter than about
+ * 3.6 [us] never reach the capture. Both channels get the same delay, so it cancels
+ * out of the phase shift.
+ */
+#define PHASE_IC_FILTER TIM_IC_DTF_DIV_32_N_8
+
+/** @brief DMA1 channel serving the TIM2_CH4 request. */
+#define PHASE_DMA_CHANNEL DMA_CHANNEL7
+
+/** @brief Registers copied per DMA request (CCR3 and CCR4). */
+#define PHASE_DMA_BURST_LENGTH 2
+
+/** @brief DMA base address field of TIM2_DCR pointing at CCR3 (register index 15). */
+#define TIM2_DCR_DBA_CCR3 15
+
+/** @brief DMA burst length field of TIM2_DCR (transfers - 1, bits 12:8). */
+#define TIM2_DCR_DBL_BURST ((PHASE_DMA_BURST_LENGTH - 1) << 8)
+
+/** @brief Capture pairs held by the DMA stream (about 1.3 s of mains cycles at 50 Hz). */
+#define PHASE_STREAM_PAIRS 64
+
+/** @brief Size of the DMA stream in 16-bit words. */
+#define PHASE_STREAM_WORDS (PHASE_STREAM_PAIRS * PHASE_DMA_BURST_LENGTH)
 
-#define PREESCALER_TM2 7200
+/** @brief Time without a new voltage edge after which the measured period is dropped (DMA capture). */
+#define PHASE_VOLTAGE_TIMEOUT_MS 100
 
-#define PERIOD_TM1 1000
+/** @brief Timer 1 period in ticks: 1 kHz PWM with a 0-1000 duty range. */
+#define PWM_PERIOD_TM1 1000
 
 
 
@@ -69,30 +159,99 @@ void gpio_setup(void);
 
 /**
  * @brief Timer2 configuration
- * This function sets the Timer 2 frequency to 10 [kHz], meaning 
- * the counter will increment by one every 100 [us] and it configures 
- * the timer for continuous counting without generating interrupts
+ * This function sets the Timer 2 frequency to 1 [MHz], meaning 
+ * the counter will increment by one every 1 [us]. The counter free-runs and
+ * channels 3 and 4 capture the rising edges on pins A2 and A3, raising the
+ * Timer 2 interrupt or, with `PHASE_CAPTURE_DMA`, feeding the DMA capture stream.
  */
 void TMR_setup_PF(void);
 
 /**
- * @brief EXTI configuration
- * This function configures pins A2 and A3 to generate external 
- * interrupts on rising edge.
+ * @brief Configures Timer 1 for PWM generation.
+ * 
+ * Initializes Timer 1 to generate a PWM signal with a frequency of 1 kHz on channel 3.
  */
-void EXTI_setup_PF(void);  
 
+void TMR_setup_pwm(void);
 
+/**
+ * @brief Phase shift state published by the capture path.
+ */
+typedef struct {
+    int32_t sum;       /**< Sum of the last `count` angles in Q15 turns. */
+    uint16_t count;    /**< Samples in the sum (up to `N_PHASE_SHIFT`). */
+    int16_t last;      /**< Most recent angle in Q15 turns (positive: current lagging). */
+    int16_t filtered;  /**< Output of `PHASE_FILTER` after the most recent sample, in Q15 turns. */
+    uint32_t samples;  /**< Total samples taken since start-up. */
+} phase_snapshot_t;
 
+/**
+ * @brief average of the stored phase angle values
+ * This function reads a consistent snapshot of the phase state and returns the output
+ * of `PHASE_FILTER`, refreshed on every current edge. It never masks interrupts and can
+ * be called at any time.
+ * With `PHASE_SOURCE_SAMPLES` the angle comes from the sample-domain detector instead.
+ *
+ * @return Average signed phase angle in degrees, from -180 to 180. Positive values
+ *         mean the current lags the voltage (inductive load), negative values that it
+ *         leads (capacitive load).
+ */
+float average_phase_shift(void);
 
+/**
+ * @brief Power factor
+ * This function derives the displacement power factor from the average phase angle.
+ * 
+ * @return cos(phi), from -1 to 1 (negative beyond +/-90 deg: power flowing back or a
+ *         reversed CT).
+ */
+float get_power_factor(void);
 
 /**
- * @brief Configures Timer 1 for PWM generation.
+ * @brief Zero-crossing validation counters.
+ */
+typedef struct {
+    uint32_t rejected_edges;    /**< Edges dropped as glitches (too soon after the previous one). */
+    uint32_t missed_edges;      /**< Edges estimated missing from over-long intervals or overcaptures. */
+    uint32_t rejected_samples;  /**< Current edges not turned into a phase sample (stale or implausible). */
+} phase_diagnostics_t;
+
+/**
+ * @brief Zero-crossing diagnostics
+ * This function returns the counters of rejected and missed edges.
  * 
- * Initializes Timer 1 to generate a PWM signal with a frequency of 1 kHz on channel 3.
+ * @return Counters accumulated since start-up.
  */
+phase_diagnostics_t get_phase_diagnostics(void);
 
-void TMR_setup_pwm(void);
+/**
+ * @brief Phase shift snapshot
+ * Seqlock reader: copies the state published by the capture path and retries if an
+ * update overlapped the copy, so the result is never torn.
+ * 
+ * @return The published phase shift state.
+ */
+phase_snapshot_t get_phase_snapshot(void);
 
-float average_phase_shift(void);
+/**
+ * @brief Consumes the DMA capture stream.
+ * Processes every (voltage, current) capture pair written since the previous call.
+ * Must be called at task level at least once per `PHASE_STREAM_PAIRS` cycles (the
+ * metering task calls it every cycle); if the DMA laps the reader meanwhile, the
+ * unread pairs are dropped and counted in `missed_edges`.
+ */
+void phase_capture_poll(void);
+
+/**
+ * @brief Mains frequency
+ * This function returns the frequency measured between consecutive voltage edges.
+ * With `PHASE_CAPTURE_DMA` the voltage edges are only read along with current edges,
+ * so the frequency is unknown while no current flows.
+ * 
+ * @return Frequency in Hz. Before a period was measured, or once the voltage edges
+ *         stopped for `PHASE_VOLTAGE_TIMEOUT_MS`: the sample-domain frequency with
+ *         `PHASE_SOURCE_CROSSCHECK`, 0 otherwise.
+ */
+float get_line_frequency(void);
 
+#endif
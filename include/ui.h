@@ -0,0 +1,178 @@
+/**
+ * @file ui.h
+ * @brief Multi-page display user interface.
+ *
+ * The screen shows one of several pages, selected with a push button. A page is a
+ * static table of fields; each field has a position, a width, a refresh period and a
+ * render function. A field is rendered when its period elapses, and written to the display
+ * framebuffer only when its text changed, so a steady value costs neither bus traffic
+ * nor framebuffer work. Switching pages is the only full redraw.
+ *
+ * The pages refresh at `UI_REFRESH_HZ`, independently of the metering cadence, from a
+ * copy of the latest metering snapshot. Each live quantity of that copy only follows
+ * the meter once it moved by more than its deadband, so noise in the last digit does
+ * not cause refreshes.
+ *
+ * Fields drawn with user-defined glyphs (bars, sparklines) are always rendered together in
+ * the same glyph frame, so one of them can never evict a glyph still shown by another.
+ */
+
+#ifndef UI_H
+#define UI_H
+
+#include <stdint.h>
+#include "libopencm3/stm32/exti.h"
+#include "display.h"
+#include "glyph.h"
+#include "sched.h"
+
+/** @brief Port of the page button. */
+#define UI_BUTTON_PORT GPIOB
+
+/** @brief Page button pin (PB12, active low with the internal pull-up). */
+#define UI_BUTTON_PIN GPIO12
+
+/** @brief EXTI line of the page button, posting `SCHED_EVENT_BUTTON`. */
+#define UI_BUTTON_EXTI EXTI12
+
+/** @brief Time the button level must stay stable to be accepted, in milliseconds. */
+#define UI_DEBOUNCE_MS 30
+
+/** @brief Display refresh rate in Hz (2 to 5); field periods shorter than it are rounded up. */
+#ifndef UI_REFRESH_HZ
+#define UI_REFRESH_HZ 4
+#endif
+
+#if UI_REFRESH_HZ < 2 || UI_REFRESH_HZ > 5
+#error "UI_REFRESH_HZ must be between 2 and 5"
+#endif
+
+/** @brief Display refresh period in SysTick milliseconds. */
+#define UI_REFRESH_MS (1000 / UI_REFRESH_HZ)
+
+/** @brief Voltage change shown, in V. */
+#define UI_DEADBAND_VOLTAGE 0.5f
+
+/** @brief Current change shown, in A. */
+#define UI_DEADBAND_CURRENT 0.02f
+
+/** @brief Power change shown, in W. */
+#define UI_DEADBAND_POWER 5.0f
+
+/** @brief Phase angle change shown, in degrees (also gates the power factor). */
+#define UI_DEADBAND_PHASE 0.5f
+
+/** @brief Frequency change shown, in Hz. */
+#define UI_DEADBAND_FREQUENCY 0.01f
+
+/** @brief Most fields on one page. */
+#define UI_MAX_FIELDS 8
+
+/** @brief Field flag: the render function uses CGRAM glyphs. */
+#define UI_FIELD_GLYPHS 0x01
+
+/** @brief Power history samples shown by the energy page sparkline. */
+#define UI_HISTORY_LENGTH 12
+
+/** @brief Seconds between power history samples (12 x 30 s: the last 6 minutes). */
+#define UI_HISTORY_STEP_S 30
+
+/** @brief Power shown as a full bar, in watts (230 V x 10 A). */
+#define UI_POWER_FULL_SCALE_W 2300.0f
+
+/**
+ * @brief Display pages, in button order.
+ */
+typedef enum {
+    UI_PAGE_INSTANT,   /**< Voltage, current, frequency, power factor, power and power bar. */
+    UI_PAGE_ENERGY,    /**< Energy, cost, demand and power history. */
+    UI_PAGE_QUALITY,   /**< Frequency, crest factors, phase angle and peak hold. */
+    UI_PAGE_STATS,     /**< Power and voltage statistics of the last period. */
+    UI_PAGE_DIAG,      /**< Edge, bus and display error counters, phase cross-check, CPU load. */
+    UI_PAGE_COUNT      /**< Number of pages. */
+} ui_page_id_t;
+
+/**
+ * @brief Renders the text of a field.
+ *
+ * @param out Destination, `width` characters plus the terminator. Shorter text is
+ *            padded with spaces.
+ * @param width Width of the field in characters.
+ */
+typedef void (*ui_render_t)(char *out, uint8_t width);
+
+/**
+ * @brief One field of a page.
+ */
+typedef struct {
+    uint8_t row;         /**< Display row. */
+    uint8_t col;         /**< First display column. */
+    uint8_t width;       /**< Width in characters. */
+    uint8_t flags;       /**< `UI_FIELD_GLYPHS` if the field uses custom characters. */
+    uint16_t period_ms;  /**< Refresh period; 0 for static text drawn with the page only. */
+    ui_render_t render;  /**< Render function. */
+} ui_field_t;
+
+/**
+ * @brief A page: its fields.
+ */
+typedef struct {
+    const ui_field_t *fields;  /**< Field table. */
+    uint8_t count;             /**< Number of fields (up to `UI_MAX_FIELDS`). */
+} ui_page_t;
+
+/**
+ * @brief Configures the page button and its interrupt, and draws the first page.
+ *
+ * Must be called after `display_init()`.
+ */
+void ui_init(void);
+
+/**
+ * @brief Runs the user interface.
+ *
+ * Debounces the button and samples the power history on every call. Every
+ * `UI_REFRESH_MS`, or at once after a page change, takes the metering snapshot
+ * through the deadbands, renders the fields that are due, then queues the glyph
+ * uploads and the changed framebuffer cells. In between, only pushes what the
+ * display had no room for at the last refresh. Run by the display task; never waits
+ * on the display.
+ */
+void ui_poll(void);
+
+/**
+ * @brief Selects a page; it is fully redrawn on the next `ui_poll()`.
+ *
+ * @param page Page to show (out of range values are ignored).
+ */
+void ui_set_page(ui_page_id_t page);
+
+/**
+ * @brief Advances to the next page, wrapping after the last one.
+ */
+void ui_next_page(void);
+
+/**
+ * @brief Returns the page shown.
+ *
+ * @return Current page.
+ */
+ui_page_id_t ui_get_page(void);
+
+/**
+ * @brief Number of refresh passes since start-up.
+ *
+ * @return Counter.
+ */
+uint32_t ui_get_refreshes(void);
+
+/**
+ * @brief Number of field writes to the framebuffer since start-up.
+ *
+ * Compared with the elapsed time it shows how much the change detection saves.
+ *
+ * @return Counter.
+ */
+uint32_t ui_get_field_writes(void);
+
+#endif
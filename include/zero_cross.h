@@ -0,0 +1,159 @@
+/**
+ * @file zero_cross.h
+ * @brief Sample-domain zero-crossing detector for the voltage and current channels.
+ *
+ * The detector runs on every ADC block. For each channel it tracks the DC bias of the
+ * sensor, arms when the signal drops below the bias by the hysteresis and reports a
+ * rising crossing when it comes back over the bias. The crossing time is interpolated
+ * linearly between the two samples around it, giving sub-sample resolution. From the
+ * crossings it derives the mains period and the signed phase angle, independently of
+ * the optocouplers.
+ *
+ * Depending on `PHASE_SOURCE` the result replaces the optocoupler measurement or is
+ * used to cross-check it.
+ */
+
+#ifndef ZERO_CROSS_H
+#define ZERO_CROSS_H
+
+#include <stdint.h>
+#include <libopencm3/cm3/sync.h>
+
+/** @brief Phase measured by the optocouplers only; the sample detector only tracks the bias. */
+#define PHASE_SOURCE_OPTO 0
+
+/** @brief Phase measured by the optocouplers and cross-checked against the samples. */
+#define PHASE_SOURCE_CROSSCHECK 1
+
+/** @brief Phase measured from the samples only; the optocoupler path is not set up. */
+#define PHASE_SOURCE_SAMPLES 2
+
+/** @brief Selected phase source. */
+#ifndef PHASE_SOURCE
+#define PHASE_SOURCE PHASE_SOURCE_CROSSCHECK
+#endif
+
+/** @brief Hysteresis around the bias, in ADC counts, before a crossing can be detected. */
+#define ZC_HYSTERESIS 40
+
+/** @brief Initial DC bias of both channels (mid-scale), in ADC counts. */
+#define ZC_INITIAL_BIAS 2048
+
+/** @brief Bias tracking speed: each block moves the bias 1/2^n of the way to the block mean. */
+#define ZC_BIAS_SHIFT 3
+
+/** @brief Phase angle smoothing: exponential average over 2^n crossings. */
+#define ZC_ANGLE_SHIFT 3
+
+/** @brief Fractional bits of the crossing timestamps (1/256 of a sample). */
+#define ZC_FRACTION_BITS 8
+
+/**
+ * @brief Delay between the voltage and current conversions of one scan, in 1/256 samples.
+ *
+ * The current channel is converted 41 ADC clocks (3.4 us at 12 MHz) after the voltage
+ * channel, which is 4.4/256 of the 200 us sample period.
+ */
+#define ZC_CURRENT_SKEW 4
+
+/** @brief Maximum disagreement between the two phase sources before it counts as a mismatch. */
+#define ZC_CROSSCHECK_TOL_DEG 5.0f
+
+/** @brief Consecutive disagreeing checks that raise the mismatch diagnostic. */
+#define ZC_CROSSCHECK_COUNT 3
+
+/**
+ * @brief Results of the sample-domain detector.
+ */
+typedef struct {
+    int16_t angle_q15;     /**< Smoothed phase angle in Q15 turns (positive: current lagging). */
+    uint32_t period;       /**< Voltage period in 1/256 samples. */
+    uint32_t v_crossings;  /**< Voltage crossings detected since start-up. */
+    uint32_t i_crossings;  /**< Current crossings paired into a phase sample since start-up. */
+} zc_snapshot_t;
+
+/**
+ * @brief Cross-check diagnostic.
+ */
+typedef struct {
+    uint8_t mismatch;         /**< Non-zero while the two phase sources disagree. */
+    uint32_t mismatch_events; /**< Times the mismatch was raised since start-up. */
+    float difference_deg;     /**< Last optocoupler minus sample angle, in degrees. */
+} zc_diagnostics_t;
+
+/**
+ * @brief Resets the detector state.
+ */
+void zc_init(void);
+
+/**
+ * @brief Runs the detector on one block of interleaved (voltage, current) samples.
+ *
+ * Called from the ADC DMA interrupt for every completed block, in order.
+ *
+ * @param block First sample of the block.
+ * @param pairs Number of (voltage, current) sample pairs in the block.
+ */
+void zc_process_block(const volatile uint16_t *block, uint16_t pairs);
+
+/**
+ * @brief Tracks the DC bias of one block without looking for crossings.
+ *
+ * Used instead of `zc_process_block()` when `PHASE_SOURCE` leaves the detector out, so
+ * the metering still has a bias to remove.
+ *
+ * @param block First sample of the block.
+ * @param pairs Number of (voltage, current) sample pairs in the block.
+ */
+void zc_track_bias(const volatile uint16_t *block, uint16_t pairs);
+
+/**
+ * @brief Returns the tracked DC bias of a channel.
+ *
+ * @param channel `0` for voltage, `1` for current.
+ * @return Bias in ADC counts, with the fraction kept by the tracker.
+ */
+float zc_get_bias(uint8_t channel);
+
+/**
+ * @brief Reads a consistent snapshot of the detector results.
+ *
+ * @return Published results (lock-free, retried if the ADC interrupt updated them meanwhile).
+ */
+zc_snapshot_t zc_get_snapshot(void);
+
+/**
+ * @brief Returns the phase angle measured from the samples.
+ *
+ * @return Signed angle in degrees (positive: current lagging).
+ */
+float zc_get_phase_angle(void);
+
+/**
+ * @brief Returns the mains frequency measured from the samples.
+ *
+ * @return Frequency in Hz, or 0 before two voltage crossings were seen.
+ */
+float zc_get_frequency(void);
+
+/**
+ * @brief Compares the optocoupler phase with the sample-domain phase.
+ *
+ * A check fails when the angles differ by more than `ZC_CROSSCHECK_TOL_DEG`, or when the
+ * samples show crossings but the optocouplers produced no new sample since the previous
+ * check. `ZC_CROSSCHECK_COUNT` failures in a row raise the mismatch diagnostic; one
+ * passing check clears it.
+ *
+ * @param opto_deg Phase angle measured by the optocouplers, in degrees.
+ * @param opto_samples Total optocoupler phase samples taken so far.
+ */
+void zc_crosscheck(float opto_deg, uint32_t opto_samples);
+
+/**
+ * @brief Returns the cross-check diagnostic.
+ *
+ * @return Mismatch state and counters.
+ */
+zc_diagnostics_t zc_get_diagnostics(void);
+
+#endif
@@ -4,17 +4,34 @@
  * 
  * This file contains the implementation of the `config_adc_dma` function, which
  * sets up the ADC (Analog-to-Digital Converter) and DMA (Direct Memory Access)
- * peripherals for continuous acquisition of analog signals.
+ * peripherals for timer-paced acquisition of analog signals, and of the DMA interrupt
+ * that hands every completed block to the sample-domain zero-crossing detector.
  * 
  * @note This file is intended to be used with its corresponding header file `adc_dma.h`.
  */
 #include "adc_dma.h"
+#include "zero_cross.h"
+
+/** @brief DMA target buffer, shared with the modules that read the samples. */
+volatile uint16_t ADC_BUFFER[ADC_BUFFER_SIZE];
+
+/** @brief Index of the last completed block of `ADC_BUFFER`. */
+static volatile uint8_t latest_block = 0;
+
+/** @brief Blocks completed since start-up. */
+static volatile uint32_t block_count = 0;
+
+/** @brief Blocks the DMA overwrote before the interrupt handed them over. */
+static volatile uint32_t lost_blocks = 0;
 
 void config_adc_dma(void) {
     // Enable peripheral clocks
     rcc_periph_clock_enable(RCC_GPIOA);
     rcc_periph_clock_enable(RCC_ADC1);
     rcc_periph_clock_enable(RCC_DMA1);
+    rcc_periph_clock_enable(RCC_TIM3);
+
+    zc_init();
 
     // Configure GPIOA pins as analog inputs for ADC channels
     gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_ANALOG, ADC_VOLTAGE_PIN | ADC_CURRENT_PIN);
@@ -30,6 +47,9 @@ void config_adc_dma(void) {
     dma_enable_circular_mode(DMA1, DMA_CHANNEL1);
     dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL1);
     dma_set_read_from_peripheral(DMA1, DMA_CHANNEL1);
+    dma_enable_half_transfer_interrupt(DMA1, DMA_CHANNEL1);
+    dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL1);
+    nvic_enable_irq(NVIC_DMA1_CHANNEL1_IRQ);
     dma_enable_channel(DMA1, DMA_CHANNEL1);
 
     // ADC setup
@@ -38,7 +58,7 @@ void config_adc_dma(void) {
     adc_disable_eoc_interrupt(ADC1);
     adc_enable_scan_mode(ADC1);  // Enable scan mode for multi-channel reading
     adc_disable_temperature_sensor();
-    adc_set_continuous_conversion_mode(ADC1);
+    adc_set_single_conversion_mode(ADC1);  // One scan per trigger
     adc_set_right_aligned(ADC1);
 
     // Set up the ADC channels and sample times
@@ -53,8 +73,69 @@ void config_adc_dma(void) {
     adc_calibrate(ADC1);
     while (adc_is_calibrating(ADC1));
 
-    adc_enable_external_trigger_regular(ADC1, ADC_CR2_EXTSEL_SWSTART);
-    adc_start_conversion_regular(ADC1);
+    adc_enable_external_trigger_regular(ADC1, ADC_CR2_EXTSEL_TIM3_TRGO);
+
+    // Timer 3 update event paces the scans
+    rcc_periph_reset_pulse(RST_TIM3);
+    timer_set_prescaler(TIM3, ADC_TRIGGER_PRESCALER - 1);
+    timer_set_period(TIM3, ADC_TRIGGER_PERIOD - 1);
+    timer_set_master_mode(TIM3, TIM_CR2_MMS_UPDATE);
+    timer_enable_counter(TIM3);
+}
+
+/**
+ * @brief Hands a completed block over to the readers and the zero-crossing detector.
+ *
+ * The DMA should be filling the other block by now. If it is already back in this one,
+ * the interrupt was held up for more than a block time (a flash erase stalls every
+ * fetch from flash, the vector table included) and the samples are being overwritten:
+ * the block is counted as lost and dropped. The stall of one page erase (40 ms at most)
+ * is shorter than the whole buffer plus a block, so the DMA cannot lap a block unseen.
+ *
+ * @param block Index of the block in `ADC_BUFFER`.
+ */
+static void adc_block_complete(uint8_t block) {
+    uint8_t filling = (dma_get_number_of_data(DMA1, DMA_CHANNEL1) > ADC_BLOCK_SIZE) ? 0 : 1;
+
+    if (filling == block) {
+        lost_blocks++;
+        return;
+    }
+#if PHASE_SOURCE != PHASE_SOURCE_OPTO
+    zc_process_block(&ADC_BUFFER[block * ADC_BLOCK_SIZE], ADC_SAMPLE_COUNT);
+#else
+    zc_track_bias(&ADC_BUFFER[block * ADC_BLOCK_SIZE], ADC_SAMPLE_COUNT);
+#endif
+    latest_block = block;
+    block_count++;
+    sched_post(SCHED_EVENT_ADC_BLOCK);
+}
+
+/**
+ * @brief DMA1 channel 1 interrupt: the first half of the buffer is complete on
+ * half-transfer, the second half on transfer-complete.
+ */
+void dma1_channel1_isr(void) {
+    if (dma_get_interrupt_flag(DMA1, DMA_CHANNEL1, DMA_HTIF)) {
+        dma_clear_interrupt_flags(DMA1, DMA_CHANNEL1, DMA_HTIF);
+        adc_block_complete(0);
+    }
+    if (dma_get_interrupt_flag(DMA1, DMA_CHANNEL1, DMA_TCIF)) {
+        dma_clear_interrupt_flags(DMA1, DMA_CHANNEL1, DMA_TCIF);
+        adc_block_complete(1);
+    }
+}
+
+const volatile uint16_t *adc_get_latest_block(void) {
+    return &ADC_BUFFER[latest_block * ADC_BLOCK_SIZE];
+}
+
+uint32_t adc_get_block_count(void) {
+    return block_count;
+}
+
+uint32_t adc_get_lost_blocks(void) {
+    return lost_blocks;
 }
 
 
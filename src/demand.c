@@ -0,0 +1,160 @@
+/**
+ * @file demand.c
+ * @brief Implementation of block and rolling demand metering.
+ *
+ * The rolling window is kept as a ring of sub-interval energy totals plus the running
+ * sum of the ring, so closing a sub-interval only subtracts the oldest slot and adds
+ * the newest one. Per-second updates touch two accumulators.
+ *
+ * @note This file should be used in conjunction with its header file `demand.h`.
+ */
+
+#include "demand.h"
+
+/** @brief Block demand interval in seconds. */
+static uint16_t block_length_s = DEMAND_DEFAULT_BLOCK_S;
+
+/** @brief Rolling sub-interval length in seconds. */
+static uint16_t subinterval_length_s = DEMAND_DEFAULT_SUBINTERVAL_S;
+
+/** @brief Number of sub-intervals in the rolling window. */
+static uint8_t subinterval_count = DEMAND_DEFAULT_SUBINTERVALS;
+
+/** @brief Energy of each closed sub-interval in mWs (ring buffer). */
+static uint64_t subinterval_ring[DEMAND_MAX_SUBINTERVALS];
+
+/** @brief Ring slot that the next closed sub-interval will overwrite. */
+static uint8_t ring_index = 0;
+
+/** @brief Number of valid slots in the ring (saturates at `subinterval_count`). */
+static uint8_t ring_filled = 0;
+
+/** @brief Sum of every slot in the ring in mWs. */
+static uint64_t window_energy = 0;
+
+/** @brief Energy of the sub-interval in progress in mWs. */
+static uint64_t subinterval_energy = 0;
+
+/** @brief Energy of the block in progress in mWs. */
+static uint64_t block_energy = 0;
+
+/** @brief Demand of the last completed block in W. */
+static uint32_t block_demand = 0;
+
+/** @brief Rolling demand over the window in W. */
+static uint32_t rolling_demand = 0;
+
+/** @brief Peak block demand register. */
+static demand_peak_t block_peak = {0, 0};
+
+/** @brief Peak rolling demand register. */
+static demand_peak_t rolling_peak = {0, 0};
+
+/**
+ * @brief Converts an interval energy into its average power.
+ *
+ * @param energy_mws Energy of the interval in mWs.
+ * @param length_s Interval length in seconds.
+ * @return Average power in W.
+ */
+static uint32_t energy_to_demand(uint64_t energy_mws, uint32_t length_s) {
+    return (uint32_t)(energy_mws / ((uint64_t)length_s * DEMAND_MWS_PER_WS));
+}
+
+/**
+ * @brief Updates a peak register if the new demand exceeds it.
+ *
+ * @param peak Peak register to update.
+ * @param demand_w Demand of the interval that just closed.
+ * @param timestamp_s Meter time at the end of that interval.
+ */
+static void update_peak(demand_peak_t *peak, uint32_t demand_w, uint32_t timestamp_s) {
+    if (demand_w > peak->demand_w) {
+        peak->demand_w = demand_w;
+        peak->timestamp_s = timestamp_s;
+    }
+}
+
+void demand_init(uint16_t block_s, uint16_t subinterval_s, uint8_t subintervals) {
+    block_length_s = (block_s != 0) ? block_s : DEMAND_DEFAULT_BLOCK_S;
+    subinterval_length_s = (subinterval_s != 0) ? subinterval_s : DEMAND_DEFAULT_SUBINTERVAL_S;
+
+    if (subintervals == 0) {
+        subintervals = DEMAND_DEFAULT_SUBINTERVALS;
+    } else if (subintervals > DEMAND_MAX_SUBINTERVALS) {
+        subintervals = DEMAND_MAX_SUBINTERVALS;
+    }
+    subinterval_count = subintervals;
+
+    for (uint8_t i = 0; i < DEMAND_MAX_SUBINTERVALS; i++) {
+        subinterval_ring[i] = 0;
+    }
+    ring_index = 0;
+    ring_filled = 0;
+    window_energy = 0;
+    subinterval_energy = 0;
+    block_energy = 0;
+    block_demand = 0;
+    rolling_demand = 0;
+    demand_reset_peaks();
+}
+
+void demand_push_second(uint32_t energy_mws, uint32_t timestamp_s) {
+    uint32_t end_s = timestamp_s + 1;  // The second covers [timestamp_s, timestamp_s + 1)
+
+    block_energy += energy_mws;
+    subinterval_energy += energy_mws;
+
+    // Close the block on its aligned boundary
+    if ((end_s % block_length_s) == 0) {
+        block_demand = energy_to_demand(block_energy, block_length_s);
+        update_peak(&block_peak, block_demand, end_s);
+        block_energy = 0;
+    }
+
+    // Close the sub-interval: drop the oldest slot from the window and add the new one
+    if ((end_s % subinterval_length_s) == 0) {
+        window_energy -= subinterval_ring[ring_index];
+        window_energy += subinterval_energy;
+        subinterval_ring[ring_index] = subinterval_energy;
+        subinterval_energy = 0;
+
+        ring_index++;
+        if (ring_index >= subinterval_count) {
+            ring_index = 0;
+        }
+
+        rolling_demand = energy_to_demand(window_energy, (uint32_t)subinterval_length_s * subinterval_count);
+
+        // A partially filled window under-reports, so it never sets the peak
+        if (ring_filled < subinterval_count) {
+            ring_filled++;
+        }
+        if (ring_filled == subinterval_count) {
+            update_peak(&rolling_peak, rolling_demand, end_s);
+        }
+    }
+}
+
+uint32_t demand_get_block_w(void) {
+    return block_demand;
+}
+
+uint32_t demand_get_rolling_w(void) {
+    return rolling_demand;
+}
+
+demand_peak_t demand_get_block_peak(void) {
+    return block_peak;
+}
+
+demand_peak_t demand_get_rolling_peak(void) {
+    return rolling_peak;
+}
+
+void demand_reset_peaks(void) {
+    block_peak.demand_w = 0;
+    block_peak.timestamp_s = 0;
+    rolling_peak.demand_w = 0;
+    rolling_peak.timestamp_s = 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file display.c
+ * @brief Shadow framebuffer and run diffing over the selected display backend.
+ */
+
+#include "display.h"
+#include "lcd.h"
+#include "ssd1306.h"
+#include "sched.h"
+
+/** @brief Backend selected by `DISPLAY_BACKEND`. */
+#if DISPLAY_BACKEND == DISPLAY_BACKEND_SSD1306
+static const display_driver_t *const display = &ssd1306_display;
+#elif DISPLAY_BACKEND == DISPLAY_BACKEND_HD44780_20X4
+static const display_driver_t *const display = &lcd_display_20x4;
+#else
+static const display_driver_t *const display = &lcd_display_16x4;
+#endif
+
+/** @brief Shadow framebuffer: what the display should show. */
+static char display_fb[DISPLAY_MAX_ROWS][DISPLAY_MAX_COLS];
+
+/** @brief What the display shows once the backend is done (0 marks an unknown cell). */
+static char display_shown[DISPLAY_MAX_ROWS][DISPLAY_MAX_COLS];
+
+/** @brief Non-zero if the last flush left changed cells the backend could not take; read by the backend interrupts. */
+static volatile uint8_t display_backlog = 0;
+
+/** @brief Times the backend was reinitialised after an error. */
+static uint32_t display_resyncs = 0;
+
+void display_init(void) {
+    display->init();
+    display_clear();
+    display_invalidate();
+}
+
+const display_caps_t *display_get_caps(void) {
+    return &display->caps;
+}
+
+void display_write(uint8_t row, uint8_t col, const char *str) {
+    if (row >= display->caps.rows) {
+        return;
+    }
+    while (*str && col < display->caps.cols) {
+        display_fb[row][col++] = *str++;
+    }
+}
+
+void display_write_line(uint8_t row, const char *str) {
+    if (row >= display->caps.rows) {
+        return;
+    }
+    for (uint8_t col = 0; col < display->caps.cols; col++) {
+        display_fb[row][col] = *str ? *str++ : ' ';
+    }
+}
+
+void display_clear(void) {
+    for (uint8_t row = 0; row < DISPLAY_MAX_ROWS; row++) {
+        for (uint8_t col = 0; col < DISPLAY_MAX_COLS; col++) {
+            display_fb[row][col] = ' ';
+        }
+    }
+}
+
+void display_invalidate(void) {
+    for (uint8_t row = 0; row < DISPLAY_MAX_ROWS; row++) {
+        for (uint8_t col = 0; col < DISPLAY_MAX_COLS; col++) {
+            display_shown[row][col] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Hands a run to the backend and records its cells as shown.
+ *
+ * @return 1 if the backend took the run, 0 if it had no room for it.
+ */
+static uint8_t display_send_run(uint8_t row, uint8_t first, uint8_t last) {
+    if (!display->write_run(row, first, &display_fb[row][first], last - first + 1)) {
+        return 0;
+    }
+    for (uint8_t col = first; col <= last; col++) {
+        display_shown[row][col] = display_fb[row][col];
+    }
+    return 1;
+}
+
+/**
+ * @brief Sends the changed cells as runs.
+ *
+ * A run is extended over up to `DISPLAY_MERGE_GAP` unchanged cells when another
+ * changed cell follows, since rewriting them costs no more than a new cursor move.
+ */
+uint16_t display_flush(void) {
+    uint16_t sent = 0;
+
+    if (display->recover()) {
+        display_resyncs++;
+        display_invalidate();
+    }
+
+    for (uint8_t row = 0; row < display->caps.rows; row++) {
+        uint8_t col = 0;
+
+        while (col < display->caps.cols) {
+            if (display_fb[row][col] == display_shown[row][col]) {
+                col++;
+                continue;
+            }
+
+            uint8_t first = col;
+            uint8_t last = col;
+            for (col++; col < display->caps.cols; col++) {
+                if (display_fb[row][col] != display_shown[row][col]) {
+                    last = col;
+                } else if (col - last > DISPLAY_MERGE_GAP) {
+                    break;
+                }
+            }
+
+            if (!display_send_run(row, first, last)) {
+                display_backlog = 1;
+                display->flush();
+                return sent;
+            }
+            sent += last - first + 1;
+        }
+    }
+    display_backlog = 0;
+    display->flush();
+    return sent;
+}
+
+uint8_t display_has_backlog(void) {
+    return display_backlog;
+}
+
+void display_backend_ready(void) {
+    if (display_backlog) {
+        sched_post(SCHED_EVENT_I2C);
+    }
+}
+
+uint8_t display_set_cursor(uint8_t row, uint8_t col) {
+    return display->set_cursor(row, col);
+}
+
+uint8_t display_define_glyph(uint8_t slot, const uint8_t rows[DISPLAY_GLYPH_ROWS]) {
+    if (!(display->caps.flags & DISPLAY_CAP_GLYPHS) || display->define_glyph == 0) {
+        return 0;
+    }
+    return display->define_glyph(slot, rows);
+}
+
+uint32_t display_get_resyncs(void) {
+    return display_resyncs;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file fmt.c
+ * @brief Bounded integer and fixed-point formatting.
+ */
+
+#include "fmt.h"
+
+#if FMT_BENCHMARK
+#include <stdio.h>
+#include <string.h>
+#include "timebase.h"
+#endif
+
+/** @brief Powers of ten up to 10^`FMT_MAX_DECIMALS`. */
+static const uint32_t fmt_powers[FMT_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+void fmt_init(fmt_t *f, char *buffer, uint8_t size) {
+    f->buffer = buffer;
+    f->size = size;
+    f->length = 0;
+    buffer[0] = '\0';
+}
+
+void fmt_char(fmt_t *f, char c) {
+    if (f->length + 1 < f->size) {
+        f->buffer[f->length++] = c;
+        f->buffer[f->length] = '\0';
+    }
+}
+
+void fmt_str(fmt_t *f, const char *str) {
+    while (*str && f->length + 1 < f->size) {
+        f->buffer[f->length++] = *str++;
+    }
+    f->buffer[f->length] = '\0';
+}
+
+void fmt_pad(fmt_t *f, uint8_t length) {
+    while (f->length < length && f->length + 1 < f->size) {
+        f->buffer[f->length++] = ' ';
+    }
+    f->buffer[f->length] = '\0';
+}
+
+/**
+ * @brief Appends a magnitude with an optional sign and decimal point.
+ *
+ * The digits are produced least significant first into a scratch buffer, then copied
+ * out in order after the padding.
+ *
+ * @param f Writer.
+ * @param magnitude Absolute value x 10^`decimals`.
+ * @param negative Non-zero to prefix a minus sign.
+ * @param decimals Digits after the decimal point.
+ * @param width Minimum width, right-aligned with spaces.
+ */
+static void fmt_number(fmt_t *f, uint32_t magnitude, uint8_t negative, uint8_t decimals, uint8_t width) {
+    char digits[10 + 1 + 1 + 1];  // uint32_t digits, leading zero, point, sign
+    uint8_t count = 0;
+
+    if (decimals > FMT_MAX_DECIMALS) {
+        decimals = FMT_MAX_DECIMALS;
+    }
+    for (uint8_t i = 0; i < decimals; i++) {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    }
+    if (decimals > 0) {
+        digits[count++] = '.';
+    }
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (negative) {
+        digits[count++] = '-';
+    }
+
+    fmt_pad(f, (width > count) ? (uint8_t)(f->length + width - count) : 0);
+    while (count > 0) {
+        fmt_char(f, digits[--count]);
+    }
+}
+
+void fmt_uint(fmt_t *f, uint32_t value, uint8_t width) {
+    fmt_number(f, value, 0, 0, width);
+}
+
+void fmt_int(fmt_t *f, int32_t value, uint8_t width) {
+    fmt_fixed(f, value, 0, width);
+}
+
+void fmt_fixed(fmt_t *f, int32_t value, uint8_t decimals, uint8_t width) {
+    uint32_t magnitude = (value < 0) ? (uint32_t)0 - (uint32_t)value : (uint32_t)value;
+
+    fmt_number(f, magnitude, value < 0, decimals, width);
+}
+
+/**
+ * @brief Rounds |value| x 10^`decimals` to an unsigned integer, saturating.
+ */
+static uint32_t fmt_scale(float value, uint8_t decimals) {
+    float scaled = ((value < 0) ? -value : value) * (float)fmt_powers[decimals] + 0.5f;
+
+    return (scaled >= 4294967295.0f) ? 0xFFFFFFFFUL : (uint32_t)scaled;
+}
+
+void fmt_float(fmt_t *f, float value, uint8_t decimals, uint8_t width) {
+    uint32_t magnitude;
+
+    if (decimals > FMT_MAX_DECIMALS) {
+        decimals = FMT_MAX_DECIMALS;
+    }
+    magnitude = fmt_scale(value, decimals);
+    if (magnitude > 0x7FFFFFFFUL) {
+        magnitude = 0x7FFFFFFFUL;
+    }
+    fmt_number(f, magnitude, value < 0 && magnitude != 0, decimals, width);
+}
+
+void fmt_power(fmt_t *f, float watts, uint8_t width) {
+    float magnitude = (watts < 0) ? -watts : watts;
+    uint8_t unit = (width > 2) ? 2 : width;
+
+    if (fmt_scale(magnitude, 0) < (uint32_t)FMT_KILO_THRESHOLD_W) {
+        fmt_float(f, watts, 0, (uint8_t)(width > 1 ? width - 1 : 0));
+        fmt_char(f, 'W');
+        return;
+    }
+
+    // Three significant digits; fewer decimals if rounding carries into a new digit
+    float kilowatts = watts / 1000.0f;
+    uint8_t decimals = 2;
+    while (decimals > 0 && fmt_scale(kilowatts, decimals) >= 1000) {
+        decimals--;
+    }
+    fmt_float(f, kilowatts, decimals, (uint8_t)(width - unit));
+    fmt_str(f, "kW");
+}
+
+#if FMT_BENCHMARK
+fmt_benchmark_t fmt_benchmark(void) {
+    fmt_benchmark_t result;
+    volatile uint32_t volts = 231;
+    volatile int32_t centihertz = 5002;
+    char line_fmt[17];
+    char line_printf[17];
+    uint32_t start;
+    fmt_t f;
+
+    start = timebase_cycles();
+    fmt_init(&f, line_fmt, sizeof(line_fmt));
+    fmt_str(&f, "U ");
+    fmt_uint(&f, volts, 3);
+    fmt_str(&f, " V  ");
+    fmt_fixed(&f, centihertz, 2, 0);
+    fmt_str(&f, "Hz");
+    result.fmt_cycles = timebase_cycles() - start;
+
+    start = timebase_cycles();
+    snprintf(line_printf, sizeof(line_printf), "U %3lu V  %ld.%02ldHz", (unsigned long)volts, (long)(centihertz / 100),
+             (long)(centihertz % 100));
+    result.snprintf_cycles = timebase_cycles() - start;
+
+    result.match = (strcmp(line_fmt, line_printf) == 0);
+    return result;
+}
+#endif
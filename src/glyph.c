@@ -0,0 +1,190 @@
+/**
+ * @file glyph.c
+ * @brief Glyph slot cache, lazy uploads, bar graph and sparkline rendering.
+ */
+
+#include "glyph.h"
+
+/** @brief Pattern held (or to be uploaded) by each slot. */
+static uint8_t slot_pattern[GLYPH_SLOTS][GLYPH_ROWS];
+
+/** @brief Bit per slot: the slot holds a pattern. */
+static uint8_t slot_assigned = 0;
+
+/** @brief Bit per slot: the pattern still has to be uploaded. */
+static uint8_t slot_pending = 0;
+
+/** @brief Bit per slot: requested by the current frame, must not be evicted. */
+static uint8_t slot_used = 0;
+
+/** @brief Request time of each slot, for least-recently-used eviction. */
+static uint32_t slot_stamp[GLYPH_SLOTS];
+
+/** @brief Request counter stamped on the slots. */
+static uint32_t glyph_clock = 0;
+
+/** @brief Display resync count at the last flush; a change means the glyphs must be reloaded. */
+static uint32_t glyph_resyncs = 0;
+
+/** @brief Glyph uploads queued since start-up. */
+static uint32_t glyph_uploads = 0;
+
+void glyph_init(void) {
+    slot_assigned = 0;
+    slot_pending = 0;
+    slot_used = 0;
+    glyph_resyncs = display_get_resyncs();
+}
+
+void glyph_begin_frame(void) {
+    slot_used = 0;
+}
+
+/**
+ * @brief Compares a pattern with the one held by a slot.
+ *
+ * @return Non-zero if equal.
+ */
+static uint8_t glyph_matches(uint8_t slot, const uint8_t pattern[GLYPH_ROWS]) {
+    for (uint8_t row = 0; row < GLYPH_ROWS; row++) {
+        if (slot_pattern[slot][row] != (pattern[row] & 0x1F)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+char glyph_get(const uint8_t pattern[GLYPH_ROWS], char fallback) {
+    uint8_t slot;
+    uint8_t victim = GLYPH_SLOTS;
+
+    if (!(display_get_caps()->flags & DISPLAY_CAP_GLYPHS)) {
+        return fallback;
+    }
+
+    glyph_clock++;
+    for (slot = 0; slot < GLYPH_SLOTS; slot++) {
+        if ((slot_assigned & (1U << slot)) && glyph_matches(slot, pattern)) {
+            slot_used |= (uint8_t)(1U << slot);
+            slot_stamp[slot] = glyph_clock;
+            return (char)(GLYPH_CODE_BASE + slot);
+        }
+    }
+
+    // A free slot, otherwise the least recently used one the frame does not need
+    for (slot = 0; slot < GLYPH_SLOTS; slot++) {
+        uint8_t bit = (uint8_t)(1U << slot);
+        if (!(slot_assigned & bit)) {
+            victim = slot;
+            break;
+        }
+        if (!(slot_used & bit) && (victim == GLYPH_SLOTS || slot_stamp[slot] < slot_stamp[victim])) {
+            victim = slot;
+        }
+    }
+    if (victim == GLYPH_SLOTS) {
+        return fallback;
+    }
+
+    for (uint8_t row = 0; row < GLYPH_ROWS; row++) {
+        slot_pattern[victim][row] = pattern[row] & 0x1F;
+    }
+    slot_assigned |= (uint8_t)(1U << victim);
+    slot_pending |= (uint8_t)(1U << victim);
+    slot_used |= (uint8_t)(1U << victim);
+    slot_stamp[victim] = glyph_clock;
+    return (char)(GLYPH_CODE_BASE + victim);
+}
+
+/**
+ * @brief Hands the pending slots to the display backend.
+ */
+uint8_t glyph_flush(void) {
+    uint8_t uploaded = 0;
+    uint32_t resyncs = display_get_resyncs();
+
+    if (resyncs != glyph_resyncs) {
+        glyph_resyncs = resyncs;
+        slot_pending = slot_assigned;  // The display was reset: reload to be safe
+    }
+
+    for (uint8_t slot = 0; slot < GLYPH_SLOTS; slot++) {
+        if (!(slot_pending & (1U << slot))) {
+            continue;
+        }
+        if (!display_define_glyph(slot, slot_pattern[slot])) {
+            break;
+        }
+        slot_pending &= (uint8_t)~(1U << slot);
+        glyph_uploads++;
+        uploaded++;
+    }
+    return uploaded;
+}
+
+uint32_t glyph_get_uploads(void) {
+    return glyph_uploads;
+}
+
+void glyph_bar(char *out, uint8_t cells, float value, float full_scale) {
+    uint16_t total = (uint16_t)cells * GLYPH_COLUMNS;
+    uint16_t lit = 0;
+
+    if (full_scale > 0 && value > 0) {
+        lit = (value >= full_scale) ? total : (uint16_t)(value * total / full_scale + 0.5f);
+    }
+
+    for (uint8_t cell = 0; cell < cells; cell++) {
+        if (lit >= GLYPH_COLUMNS) {
+            out[cell] = GLYPH_FULL_BLOCK;
+            lit -= GLYPH_COLUMNS;
+        } else if (lit > 0) {
+            uint8_t pattern[GLYPH_ROWS];
+            uint8_t columns = (uint8_t)((0x1F << (GLYPH_COLUMNS - lit)) & 0x1F);
+            for (uint8_t row = 0; row < GLYPH_ROWS; row++) {
+                pattern[row] = columns;
+            }
+            out[cell] = glyph_get(pattern, ' ');
+            lit = 0;
+        } else {
+            out[cell] = ' ';
+        }
+    }
+    out[cells] = '\0';
+}
+
+void glyph_sparkline(char *out, const float *samples, uint8_t count, float low, float high) {
+    if (!(high > low)) {
+        low = high = (count > 0) ? samples[0] : 0;
+        for (uint8_t i = 1; i < count; i++) {
+            if (samples[i] < low) {
+                low = samples[i];
+            }
+            if (samples[i] > high) {
+                high = samples[i];
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t level = 0;
+
+        if (high > low) {
+            float scaled = (samples[i] - low) * GLYPH_ROWS / (high - low) + 0.5f;
+            level = (scaled <= 0) ? 0 : (scaled >= GLYPH_ROWS) ? GLYPH_ROWS : (uint8_t)scaled;
+        }
+
+        if (level == 0) {
+            out[i] = ' ';
+        } else if (level == GLYPH_ROWS) {
+            out[i] = GLYPH_FULL_BLOCK;
+        } else {
+            uint8_t pattern[GLYPH_ROWS];
+            for (uint8_t row = 0; row < GLYPH_ROWS; row++) {
+                pattern[row] = (row >= GLYPH_ROWS - level) ? 0x1F : 0x00;
+            }
+            out[i] = glyph_get(pattern, GLYPH_FALLBACK);
+        }
+    }
+    out[count] = '\0';
+}
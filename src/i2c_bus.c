@@ -0,0 +1,328 @@
+/**
+ * @file i2c_bus.c
+ * @brief Interrupt-driven I2C1 master write and read state machine.
+ *
+ * Event sequence of a write on the STM32F1 I2C peripheral:
+ * - SB: start sent, the address is written.
+ * - ADDR: address acknowledged, cleared by reading SR1 then SR2.
+ * - TXE: data register empty, the next byte is written. After the last one the buffer
+ *   interrupt is disabled so the next event is BTF.
+ * - BTF: last byte shifted out, the stop condition is requested and the transaction ends.
+ *
+ * A DMA transaction skips the TXE step: after ADDR the DMA writes every byte, its
+ * transfer complete interrupt hands the transaction back, and BTF ends it as above.
+ *
+ * A read, of a single byte only, replaces the data steps:
+ * - ADDR: ACK is cleared and the stop requested before ADDR is cleared, so the byte
+ *   is not acknowledged.
+ * - RXNE: the byte is read and the transaction ends.
+ *
+ * NACK, bus error and arbitration loss arrive on the error interrupt, which releases
+ * the bus and reports the failure to the callback. A transaction that never completes
+ * (SDA held low, peripheral stuck) is caught by its deadline in `i2c_bus_poll()`.
+ */
+
+#include "i2c_bus.h"
+
+/** @brief Address of the transaction in flight. */
+static uint8_t bus_address;
+
+/** @brief Data of the transaction in flight. */
+static const uint8_t *bus_data;
+
+/** @brief Length of the transaction in flight. */
+static uint8_t bus_length;
+
+/** @brief Destination of the read in flight, NULL for a write. */
+static uint8_t *bus_rx;
+
+/** @brief Next byte of `bus_data` to be written, or of `bus_rx` to be read. */
+static uint8_t bus_index;
+
+/** @brief Callback of the transaction in flight. */
+static i2c_bus_callback_t bus_done;
+
+/** @brief Non-zero if the transaction in flight is fed by DMA. */
+static volatile uint8_t bus_dma = 0;
+
+/** @brief Non-zero while a transaction is in flight. */
+static volatile uint8_t bus_busy = 0;
+
+/** @brief SysTick periods left before the transaction in flight overruns its deadline. */
+static volatile uint16_t bus_ticks_left = 0;
+
+/** @brief Error counters. */
+static volatile i2c_bus_stats_t bus_stats = {0, 0, 0, 0};
+
+/**
+ * @brief Programs the I2C1 timing registers and enables the peripheral.
+ */
+static void i2c_bus_configure(void) {
+    i2c_peripheral_disable(I2C1);
+    i2c_set_clock_frequency(I2C1, I2C_BUS_PCLK_MHZ);
+#if I2C_BUS_FAST_MODE
+    i2c_set_fast_mode(I2C1);
+    i2c_set_dutycycle(I2C1, I2C_CCR_DUTY_DIV2);
+    i2c_set_ccr(I2C1, I2C_BUS_CCR_FAST);
+    i2c_set_trise(I2C1, I2C_BUS_TRISE_FAST);
+#else
+    i2c_set_standard_mode(I2C1);
+    i2c_set_ccr(I2C1, I2C_BUS_CCR_STANDARD);
+    i2c_set_trise(I2C1, I2C_BUS_TRISE_STANDARD);
+#endif
+    i2c_peripheral_enable(I2C1);
+}
+
+void i2c_bus_init(void) {
+    rcc_periph_clock_enable(RCC_GPIOB);
+    rcc_periph_clock_enable(RCC_I2C1);
+    rcc_periph_clock_enable(RCC_DMA1);
+
+    gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_OPENDRAIN, I2C_BUS_SDA_PIN | I2C_BUS_SCL_PIN);
+    i2c_bus_configure();
+
+    nvic_enable_irq(NVIC_I2C1_EV_IRQ);
+    nvic_enable_irq(NVIC_I2C1_ER_IRQ);
+    nvic_enable_irq(NVIC_DMA1_CHANNEL6_IRQ);
+}
+
+/**
+ * @brief Programs the TX DMA channel for the transaction in flight and arms I2C1 DMA requests.
+ */
+static void i2c_bus_dma_start(void) {
+    dma_channel_reset(DMA1, I2C_BUS_DMA_CHANNEL);
+    dma_set_priority(DMA1, I2C_BUS_DMA_CHANNEL, DMA_CCR_PL_MEDIUM);
+    dma_set_peripheral_address(DMA1, I2C_BUS_DMA_CHANNEL, (uint32_t)&I2C_DR(I2C1));
+    dma_set_memory_address(DMA1, I2C_BUS_DMA_CHANNEL, (uint32_t)bus_data);
+    dma_set_number_of_data(DMA1, I2C_BUS_DMA_CHANNEL, bus_length);
+    dma_set_memory_size(DMA1, I2C_BUS_DMA_CHANNEL, DMA_CCR_MSIZE_8BIT);
+    dma_set_peripheral_size(DMA1, I2C_BUS_DMA_CHANNEL, DMA_CCR_PSIZE_8BIT);
+    dma_enable_memory_increment_mode(DMA1, I2C_BUS_DMA_CHANNEL);
+    dma_set_read_from_memory(DMA1, I2C_BUS_DMA_CHANNEL);
+    dma_enable_transfer_complete_interrupt(DMA1, I2C_BUS_DMA_CHANNEL);
+    dma_enable_channel(DMA1, I2C_BUS_DMA_CHANNEL);
+    i2c_enable_dma(I2C1);
+}
+
+/**
+ * @brief Stops the TX DMA channel and I2C1 DMA requests.
+ */
+static void i2c_bus_dma_stop(void) {
+    dma_disable_channel(DMA1, I2C_BUS_DMA_CHANNEL);
+    i2c_disable_dma(I2C1);
+}
+
+void i2c_bus_recover(void) {
+    i2c_disable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+    i2c_peripheral_disable(I2C1);
+
+    // Drive the lines as open-drain GPIOs, both released
+    gpio_set(GPIOB, I2C_BUS_SDA_PIN | I2C_BUS_SCL_PIN);
+    gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_OPENDRAIN, I2C_BUS_SDA_PIN | I2C_BUS_SCL_PIN);
+    delay_us(I2C_BUS_RECOVERY_HALF_US);
+
+    // Clock out whatever byte the slave is still sending until it lets SDA go
+    for (uint8_t i = 0; i < I2C_BUS_RECOVERY_PULSES && !gpio_get(GPIOB, I2C_BUS_SDA_PIN); i++) {
+        gpio_clear(GPIOB, I2C_BUS_SCL_PIN);
+        delay_us(I2C_BUS_RECOVERY_HALF_US);
+        gpio_set(GPIOB, I2C_BUS_SCL_PIN);
+        delay_us(I2C_BUS_RECOVERY_HALF_US);
+    }
+
+    // Stop condition: SDA rises while SCL is high
+    gpio_clear(GPIOB, I2C_BUS_SCL_PIN);
+    delay_us(I2C_BUS_RECOVERY_HALF_US);
+    gpio_clear(GPIOB, I2C_BUS_SDA_PIN);
+    delay_us(I2C_BUS_RECOVERY_HALF_US);
+    gpio_set(GPIOB, I2C_BUS_SCL_PIN);
+    delay_us(I2C_BUS_RECOVERY_HALF_US);
+    gpio_set(GPIOB, I2C_BUS_SDA_PIN);
+    delay_us(I2C_BUS_RECOVERY_HALF_US);
+
+    // Back to the peripheral, reset so a stuck BUSY flag is cleared
+    gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_OPENDRAIN, I2C_BUS_SDA_PIN | I2C_BUS_SCL_PIN);
+    I2C_CR1(I2C1) |= I2C_CR1_SWRST;
+    I2C_CR1(I2C1) &= ~I2C_CR1_SWRST;
+    i2c_bus_configure();
+
+    bus_stats.recoveries++;
+}
+
+/**
+ * @brief Ends the transaction in flight and reports its status.
+ *
+ * @param status Result passed to the callback.
+ */
+static void i2c_bus_finish(uint8_t status) {
+    i2c_bus_callback_t done = bus_done;
+
+    i2c_disable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+    if (bus_dma) {
+        i2c_bus_dma_stop();
+        bus_dma = 0;
+    }
+    bus_rx = 0;
+    bus_busy = 0;
+    if (done) {
+        done(status);
+    }
+}
+
+uint8_t i2c_bus_write(uint8_t address, const uint8_t *data, uint8_t length, i2c_bus_callback_t done) {
+    if (bus_busy || length == 0) {
+        return 0;
+    }
+    bus_busy = 1;
+    bus_address = address;
+    bus_data = data;
+    bus_rx = 0;
+    bus_length = length;
+    bus_index = 0;
+    bus_done = done;
+    bus_ticks_left = I2C_BUS_TIMEOUT_TICKS(length);
+
+    if (length >= I2C_BUS_DMA_MIN_LENGTH) {
+        bus_dma = 1;
+        i2c_bus_dma_start();
+        i2c_enable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+    } else {
+        i2c_enable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+    }
+    i2c_send_start(I2C1);
+    return 1;
+}
+
+uint8_t i2c_bus_read(uint8_t address, uint8_t *data, uint8_t length, i2c_bus_callback_t done) {
+    if (bus_busy || length != 1) {
+        return 0;
+    }
+    bus_busy = 1;
+    bus_address = address;
+    bus_data = 0;
+    bus_rx = data;
+    bus_length = length;
+    bus_index = 0;
+    bus_done = done;
+    bus_ticks_left = I2C_BUS_TIMEOUT_TICKS(length);
+
+    i2c_enable_interrupt(I2C1, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | I2C_CR2_ITERREN);
+    i2c_send_start(I2C1);
+    return 1;
+}
+
+uint8_t i2c_bus_busy(void) {
+    return bus_busy;
+}
+
+void i2c_bus_poll(void) {
+    // Counted on SysTick: the DWT cycle counter stops while the core sleeps in WFI
+    if (bus_busy && --bus_ticks_left == 0) {
+        bus_stats.timeouts++;
+        i2c_bus_recover();
+        i2c_bus_finish(I2C_BUS_TIMEOUT);
+    }
+}
+
+i2c_bus_stats_t i2c_bus_get_stats(void) {
+    i2c_bus_stats_t copy;
+
+    copy.nacks = bus_stats.nacks;
+    copy.bus_errors = bus_stats.bus_errors;
+    copy.timeouts = bus_stats.timeouts;
+    copy.recoveries = bus_stats.recoveries;
+    return copy;
+}
+
+/**
+ * @brief Read steps of the event interrupt.
+ *
+ * @param sr1 Status register 1 as read by the interrupt.
+ */
+static void i2c_bus_read_event(uint32_t sr1) {
+    if (sr1 & I2C_SR1_ADDR) {
+        i2c_disable_ack(I2C1);
+        (void)I2C_SR2(I2C1);  // Clears ADDR, the byte is received with NACK
+        i2c_send_stop(I2C1);
+        return;
+    }
+    if (sr1 & I2C_SR1_RxNE) {
+        bus_rx[bus_index++] = i2c_get_data(I2C1);
+        i2c_bus_finish(I2C_BUS_OK);
+    }
+}
+
+/**
+ * @brief I2C1 event interrupt: advances the write or read state machine.
+ */
+void i2c1_ev_isr(void) {
+    uint32_t sr1 = I2C_SR1(I2C1);
+
+    if (sr1 & I2C_SR1_SB) {
+        i2c_send_7bit_address(I2C1, bus_address, bus_rx ? I2C_READ : I2C_WRITE);
+        return;
+    }
+    if (bus_rx) {
+        i2c_bus_read_event(sr1);
+        return;
+    }
+    if (sr1 & I2C_SR1_ADDR) {
+        (void)I2C_SR2(I2C1);  // Reading SR2 after SR1 clears ADDR
+    }
+    if (bus_dma) {
+        // The DMA feeds the data; end once it is done and the last byte is out
+        if ((sr1 & I2C_SR1_BTF) && bus_index == bus_length) {
+            i2c_send_stop(I2C1);
+            i2c_bus_finish(I2C_BUS_OK);
+        }
+        return;
+    }
+    if (sr1 & (I2C_SR1_TxE | I2C_SR1_ADDR)) {
+        if (bus_index < bus_length) {
+            i2c_send_data(I2C1, bus_data[bus_index++]);
+            if (bus_index == bus_length) {
+                i2c_disable_interrupt(I2C1, I2C_CR2_ITBUFEN);  // Wait for BTF only
+            }
+        } else if (sr1 & I2C_SR1_BTF) {
+            i2c_send_stop(I2C1);
+            i2c_bus_finish(I2C_BUS_OK);
+        }
+    }
+}
+
+/**
+ * @brief DMA1 channel 6 interrupt: every byte of a DMA transaction is in the data register.
+ *
+ * The last byte is still being shifted out; the BTF event that follows sends the stop.
+ */
+void dma1_channel6_isr(void) {
+    if (dma_get_interrupt_flag(DMA1, I2C_BUS_DMA_CHANNEL, DMA_TCIF)) {
+        dma_clear_interrupt_flags(DMA1, I2C_BUS_DMA_CHANNEL, DMA_TCIF);
+        i2c_bus_dma_stop();
+        bus_index = bus_length;
+    }
+}
+
+/**
+ * @brief I2C1 error interrupt: releases the bus and fails the transaction.
+ *
+ * A NACK only needs a stop condition. A bus error or lost arbitration leaves the bus
+ * state unknown, so the bus is recovered.
+ */
+void i2c1_er_isr(void) {
+    uint32_t sr1 = I2C_SR1(I2C1);
+    uint8_t status;
+
+    I2C_SR1(I2C1) = sr1 & ~(I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR);
+    if (sr1 & I2C_SR1_AF) {
+        bus_stats.nacks++;
+        i2c_send_stop(I2C1);
+        status = I2C_BUS_NACK;
+    } else {
+        bus_stats.bus_errors++;
+        i2c_bus_recover();
+        status = I2C_BUS_ERROR;
+    }
+    if (bus_busy) {
+        i2c_bus_finish(status);
+    }
+}
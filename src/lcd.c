@@ -13,87 +13,455 @@
 volatile uint32_t sys_milis = 0;  // Variable to store the number of milliseconds elapsed
 
 /**
- * @brief Sends a pulse to the LCD's Enable (EN) pin to latch data.
- * 
- * This function sets the Enable line (EN) high to latch the command, then sets it low.
- * It uses I2C to communicate with the PCF8574 I/O expander connected to the LCD.
- * 
- * @param data The byte to be latched.
+ * @brief One queued HD44780 transfer.
+ */
+typedef struct {
+    uint8_t value;     /**< Command or character (only the high nibble with `LCD_OP_NIBBLE`). */
+    uint8_t flags;     /**< `LCD_RS` for data, `LCD_OP_NIBBLE` for a single nibble, `LCD_OP_WAIT` for a pure wait. */
+    uint16_t wait_us;  /**< Extra wait after the transfer, in microseconds. */
+} lcd_op_t;
+
+/** @brief Operation queue: written by the main loop at the head, drained by interrupts at the tail. */
+static lcd_op_t lcd_queue[LCD_QUEUE_SIZE];
+
+/** @brief Next free slot of `lcd_queue`, owned by the main loop. */
+static volatile uint16_t lcd_head = 0;
+
+/** @brief Operation being sent, owned by the interrupts. */
+static volatile uint16_t lcd_tail = 0;
+
+/** @brief Non-zero while the interrupt chain is draining the queue. */
+static volatile uint8_t lcd_running = 0;
+
+/** @brief Operations in the transaction in flight. */
+static uint16_t lcd_batch_ops = 0;
+
+/** @brief Wait after the transaction in flight, in microseconds. */
+static uint16_t lcd_batch_wait = 0;
+
+/** @brief Non-zero if the transaction in flight ends with a command whose wait is polled. */
+static uint8_t lcd_batch_poll = 0;
+
+/** @brief Expander bytes handed to the I2C bus for the transaction in flight. */
+static uint8_t lcd_tx[LCD_BATCH_OPS * LCD_BYTES_PER_OP];
+
+/** @brief Operations dropped because the queue was full. */
+static uint32_t lcd_overflows = 0;
+
+/** @brief Set by a failed transaction: the LCD state is unknown until it is reinitialised. */
+static volatile uint8_t lcd_fault = 0;
+
+/** @brief DDRAM address of the first cell of each row of a 16x4 module. */
+static const uint8_t lcd_rows_16x4[LCD_ROWS] = {0x00, 0x40, 0x10, 0x50};
+
+/** @brief DDRAM address of the first cell of each row of a 20x4 module. */
+static const uint8_t lcd_rows_20x4[LCD_ROWS] = {0x00, 0x40, 0x14, 0x54};
+
+/** @brief Row addresses of the module in use. */
+static const uint8_t *lcd_row_address = lcd_rows_16x4;
+
+/** @brief Columns of the module in use. */
+static uint8_t lcd_cols = 16;
+
+/** @brief Non-zero while busy flag polling is in use; cleared after repeated failures. */
+static volatile uint8_t lcd_busy_poll = LCD_BUSY_POLL;
+
+/** @brief Consecutive failed polls. */
+static uint8_t lcd_poll_failures = 0;
+
+/** @brief Non-zero when the wait timer ends with a poll instead of the next transaction. */
+static volatile uint8_t lcd_poll_pending = 0;
+
+/** @brief Cycle counter when the polled command had been sent. */
+static uint32_t lcd_poll_since;
+
+/** @brief Timed wait of the polled command, in microseconds. */
+static uint16_t lcd_poll_wait;
+
+/** @brief Expander port read while EN is high. */
+static uint8_t lcd_poll_rx;
+
+/** @brief R/W high with the data nibble released (written high), then EN high: the LCD drives BF and AC6-4. */
+static const uint8_t lcd_poll_strobe[] = {
+    0xF0 | LCD_BACKLIGHT | LCD_RW,
+    0xF0 | LCD_BACKLIGHT | LCD_RW | LCD_EN,
+};
+
+/** @brief EN low, a second EN pulse for the low nibble (AC3-0, ignored), then R/W low. */
+static const uint8_t lcd_poll_release[] = {
+    0xF0 | LCD_BACKLIGHT | LCD_RW,
+    0xF0 | LCD_BACKLIGHT | LCD_RW | LCD_EN,
+    0xF0 | LCD_BACKLIGHT | LCD_RW,
+    0xF0 | LCD_BACKLIGHT,
+};
+
+/** @brief Busy flag polling counters. */
+static lcd_busy_stats_t lcd_busy_stats = {0, 0, 0, 0, 0};
+
+static void lcd_write_done(uint8_t status);
+static void lcd_poll(void);
+static void lcd_queue_init_sequence(void);
+
+/**
+ * @brief Starts the one-pulse wait timer; its interrupt continues the queue.
+ *
+ * @param us Wait in microseconds (1 to 65535).
+ */
+static void lcd_wait_start(uint16_t us) {
+    timer_set_period(LCD_WAIT_TIMER, us - 1);
+    timer_set_counter(LCD_WAIT_TIMER, 0);
+    timer_enable_counter(LCD_WAIT_TIMER);
+}
+
+/**
+ * @brief Packs one operation into expander bytes.
+ *
+ * Each nibble takes two bytes that the PCF8574 latches onto the LCD pins: data with EN
+ * high, then the same data with EN low, whose falling edge clocks the nibble in.
+ *
+ * @param op Operation to pack.
+ * @param out Destination, room for `LCD_BYTES_PER_OP` bytes.
+ * @return Number of bytes written (2 for a single nibble, 4 for a byte).
+ */
+static uint8_t lcd_pack(const lcd_op_t *op, uint8_t *out) {
+    uint8_t control = (op->flags & LCD_RS) | LCD_BACKLIGHT;
+    uint8_t high = (op->value & 0xF0) | control;
+    uint8_t low = ((op->value << 4) & 0xF0) | control;
+
+    out[0] = high | LCD_EN;
+    out[1] = high;
+    if (op->flags & LCD_OP_NIBBLE) {
+        return 2;
+    }
+    out[2] = low | LCD_EN;
+    out[3] = low;
+    return 4;
+}
+
+/**
+ * @brief Sends the operations at the tail as one I2C transaction.
+ *
+ * Operations are packed while their wait is covered by the bus time of the next one,
+ * up to `LCD_BATCH_OPS`; an operation needing a longer wait ends the transaction and
+ * its wait is timed after it. A pure wait operation only arms the timer. Clears
+ * `lcd_running` when the queue is empty, and tells the display layer it has room.
+ */
+static void lcd_send_batch(void) {
+    uint16_t head = lcd_head;
+    uint16_t index = lcd_tail;
+    uint16_t count = 0;
+    uint8_t length = 0;
+    uint8_t flags;
+    uint16_t wait;
+
+    if (index == head) {
+        lcd_running = 0;
+        display_backend_ready();
+        return;
+    }
+    if (lcd_queue[index].flags & LCD_OP_WAIT) {
+        lcd_batch_ops = 1;
+        lcd_batch_wait = lcd_queue[index].wait_us;
+        lcd_batch_poll = 0;
+        lcd_write_done(I2C_BUS_OK);
+        return;
+    }
+
+    do {
+        const lcd_op_t *op = &lcd_queue[index];
+        length += lcd_pack(op, &lcd_tx[length]);
+        flags = op->flags;
+        wait = op->wait_us;
+        count++;
+        index = (index + 1) % LCD_QUEUE_SIZE;
+    } while (index != head && count < LCD_BATCH_OPS && wait <= LCD_BATCH_COVER_US
+             && !(lcd_queue[index].flags & LCD_OP_WAIT));
+
+    lcd_batch_ops = count;
+    lcd_batch_wait = wait;
+    // The busy flag is only readable once the controller is in 4-bit mode
+    lcd_batch_poll = lcd_busy_poll && !(flags & LCD_OP_NIBBLE) && wait >= LCD_BUSY_POLL_MIN_US;
+    if (!i2c_bus_write(PCF8574_ADDRESS, lcd_tx, length, lcd_write_done)) {
+        lcd_batch_ops = 0;
+        lcd_batch_poll = 0;
+        lcd_wait_start(LCD_T_EXEC_US);  // Bus still busy: try again after a wait
+    }
+}
+
+/**
+ * @brief I2C completion: retires the sent operations and arms the wait after them.
+ *
+ * A wait of at least `LCD_BUSY_POLL_MIN_US` starts polling the busy flag instead.
+ * A failed transaction is not retried. The LCD may have latched part of it, so it is
+ * flagged for reinitialisation and the next transaction is delayed by
+ * `LCD_ERROR_BACKOFF_US`, which keeps a missing display from flooding the bus.
+ *
+ * @param status I2C result.
+ */
+static void lcd_write_done(uint8_t status) {
+    uint16_t wait = lcd_batch_wait ? lcd_batch_wait : 1;
+    uint8_t poll = lcd_batch_poll;
+
+    lcd_batch_poll = 0;
+    if (status != I2C_BUS_OK) {
+        lcd_fault = 1;
+        wait = LCD_ERROR_BACKOFF_US;
+        poll = 0;
+    }
+    lcd_tail = (lcd_tail + lcd_batch_ops) % LCD_QUEUE_SIZE;
+    lcd_batch_ops = 0;
+    if (poll) {
+        lcd_poll_since = timebase_cycles();
+        lcd_poll_wait = wait;
+        lcd_poll();
+        return;
+    }
+    lcd_wait_start(wait);
+}
+
+/**
+ * @brief Gives up on a poll and waits out the rest of the timed wait instead.
+ *
+ * After `LCD_BUSY_POLL_MAX_FAILURES` failures in a row, polling is switched off. An
+ * I2C error leaves R/W in an unknown state, so it is handled like a failed write.
+ *
+ * @param status I2C result of the failed step, `I2C_BUS_OK` for a busy flag stuck high.
+ */
+static void lcd_poll_fail(uint8_t status) {
+    uint32_t elapsed = timebase_elapsed_us(lcd_poll_since);
+    uint16_t wait = elapsed < lcd_poll_wait ? (uint16_t)(lcd_poll_wait - elapsed) : 1;
+
+    lcd_busy_stats.fallbacks++;
+    if (++lcd_poll_failures >= LCD_BUSY_POLL_MAX_FAILURES) {
+        lcd_busy_poll = 0;
+    }
+    if (status != I2C_BUS_OK) {
+        lcd_fault = 1;
+        wait = LCD_ERROR_BACKOFF_US;
+    }
+    lcd_wait_start(wait);
+}
+
+/**
+ * @brief Last poll step done: sends the next transaction if the LCD is ready, or polls again later.
+ *
+ * @param status I2C result.
+ */
+static void lcd_poll_released(uint8_t status) {
+    uint32_t elapsed;
+
+    if (status != I2C_BUS_OK) {
+        lcd_poll_fail(status);
+        return;
+    }
+    elapsed = timebase_elapsed_us(lcd_poll_since);
+    if (!(lcd_poll_rx & LCD_BUSY_FLAG)) {
+        lcd_poll_failures = 0;
+        lcd_busy_stats.early++;
+        if (elapsed < lcd_poll_wait) {
+            lcd_busy_stats.saved_us += lcd_poll_wait - elapsed;
+        }
+        lcd_send_batch();
+        return;
+    }
+    if (elapsed > (uint32_t)lcd_poll_wait * LCD_BUSY_POLL_TIMEOUT_FACTOR) {
+        lcd_poll_fail(I2C_BUS_OK);  // Reads high whatever the LCD does: R/W is not wired
+        return;
+    }
+    lcd_poll_pending = 1;
+    lcd_wait_start(LCD_BUSY_POLL_INTERVAL_US);
+}
+
+/**
+ * @brief Port read: releases the data lines with the rest of the read cycle.
+ *
+ * @param status I2C result.
+ */
+static void lcd_poll_read(uint8_t status) {
+    if (status != I2C_BUS_OK) {
+        lcd_poll_fail(status);
+        return;
+    }
+    if (!i2c_bus_write(PCF8574_ADDRESS, lcd_poll_release, sizeof(lcd_poll_release), lcd_poll_released)) {
+        lcd_poll_fail(I2C_BUS_ERROR);
+    }
+}
+
+/**
+ * @brief EN is high with R/W set: reads the expander port.
+ *
+ * @param status I2C result.
+ */
+static void lcd_poll_strobed(uint8_t status) {
+    if (status != I2C_BUS_OK) {
+        lcd_poll_fail(status);
+        return;
+    }
+    if (!i2c_bus_read(PCF8574_ADDRESS, &lcd_poll_rx, 1, lcd_poll_read)) {
+        lcd_poll_fail(I2C_BUS_ERROR);
+    }
+}
+
+/**
+ * @brief Starts one busy flag read: strobe, port read, release, chained by their callbacks.
+ */
+static void lcd_poll(void) {
+    lcd_busy_stats.polls++;
+    if (!i2c_bus_write(PCF8574_ADDRESS, lcd_poll_strobe, sizeof(lcd_poll_strobe), lcd_poll_strobed)) {
+        lcd_poll_fail(I2C_BUS_OK);  // Bus busy: nothing was sent, wait the timed way
+    }
+}
+
+/**
+ * @brief Timer 4 interrupt: the wait is over, send the next transaction or poll again.
+ */
+void tim4_isr(void) {
+    timer_clear_flag(LCD_WAIT_TIMER, TIM_SR_UIF);
+    if (lcd_poll_pending) {
+        lcd_poll_pending = 0;
+        lcd_poll();
+    } else {
+        lcd_send_batch();
+    }
+}
+
+/**
+ * @brief Starts draining the queue if the interrupt chain is not already running.
+ *
+ * Interrupts are masked so the chain cannot stop between the check and the start.
+ */
+static void lcd_kick(void) {
+    uint32_t primask = cm_mask_interrupts(1);
+
+    if (!lcd_running) {
+        lcd_running = 1;
+        lcd_send_batch();
+    }
+    cm_mask_interrupts(primask);
+}
+
+/**
+ * @brief Appends an operation to the queue without starting the drain.
+ *
+ * @return 1 if queued, 0 if the queue is full.
  */
-void lcd_pulse_enable(uint8_t data) {
-    uint8_t d = data | LCD_EN;
-    i2c_transfer7(I2C1, PCF8574_ADDRESS, &d, 1, NULL, 0);
-    delay_ms(2);
+static uint8_t lcd_enqueue(uint8_t value, uint8_t flags, uint16_t wait_us) {
+    uint16_t next = (lcd_head + 1) % LCD_QUEUE_SIZE;
 
-    d = data & ~LCD_EN;
-    i2c_transfer7(I2C1, PCF8574_ADDRESS, &d, 1, NULL, 0);
-    delay_ms(2);
+    if (next == lcd_tail) {
+        lcd_overflows++;
+        return 0;
+    }
+    lcd_queue[lcd_head].value = value;
+    lcd_queue[lcd_head].flags = flags;
+    lcd_queue[lcd_head].wait_us = wait_us;
+    __dmb();  // Publish the queued operation before the head moves
+    lcd_head = next;
+    return 1;
+}
+
+/**
+ * @brief Returns the HD44780 execution time of a transfer.
+ *
+ * Clear display and return home take 1.52 ms; every other command 37 us; a data
+ * write 37 us plus the address counter update.
+ *
+ * @param byte Command or character.
+ * @param mode `LCD_RS` for data, `0` for commands.
+ * @return Minimum wait in microseconds.
+ */
+uint16_t lcd_command_wait_us(uint8_t byte, uint8_t mode) {
+    if (mode & LCD_RS) {
+        return LCD_T_EXEC_US + LCD_T_ADD_US;
+    }
+    if (byte == LCD_CLEARDISPLAY || (byte & 0xFE) == LCD_RETURNHOME) {
+        return LCD_T_CLEAR_US;
+    }
+    return LCD_T_EXEC_US;
 }
 
 /**
- * @brief Sends a 4-bit nibble to the LCD and latches it.
+ * @brief Queues a 4-bit nibble for the LCD.
  * 
  * @param nibble The 4-bit nibble to be sent (upper nibble of a byte).
  * @param mode   The mode of the command (`LCD_RS` for data, `0` for commands).
+ * @param wait_us Wait after the nibble, in microseconds.
+ * @return 1 if queued, 0 if the queue is full.
  */
-void lcd_send_nibble(uint8_t nibble, uint8_t mode) {
-    uint8_t data = (nibble & 0xF0) | mode | LCD_BACKLIGHT;
-    lcd_pulse_enable(data);
+uint8_t lcd_send_nibble(uint8_t nibble, uint8_t mode, uint16_t wait_us) {
+    uint8_t queued = lcd_enqueue(nibble & 0xF0, (mode & LCD_RS) | LCD_OP_NIBBLE, wait_us);
+    lcd_kick();
+    return queued;
 }
 
 /**
- * @brief Sends an 8-bit byte to the LCD by splitting it into two 4-bit nibbles.
+ * @brief Queues an 8-bit byte for the LCD, sent as two 4-bit nibbles.
  * 
  * @param byte The byte to be sent.
  * @param mode The mode of the command (`LCD_RS` for data, `0` for commands).
+ * @return 1 if queued, 0 if the queue is full.
+ */
+uint8_t lcd_send_byte(uint8_t byte, uint8_t mode) {
+    uint8_t queued = lcd_enqueue(byte, mode & LCD_RS, lcd_command_wait_us(byte, mode));
+    lcd_kick();
+    return queued;
+}
+
+/**
+ * @brief Configures Timer 4 as a one-pulse microsecond timer with its update interrupt.
  */
-void lcd_send_byte(uint8_t byte, uint8_t mode) {
-    lcd_send_nibble(byte & 0xF0, mode);
-    lcd_send_nibble((byte << 4) & 0xF0, mode);
-    delay_ms(2);
+static void lcd_wait_timer_setup(void) {
+    rcc_periph_clock_enable(RCC_TIM4);
+    rcc_periph_reset_pulse(RST_TIM4);
+    timer_set_prescaler(LCD_WAIT_TIMER, LCD_WAIT_PRESCALER - 1);
+    timer_one_shot_mode(LCD_WAIT_TIMER);
+    timer_update_on_overflow(LCD_WAIT_TIMER);
+    timer_generate_event(LCD_WAIT_TIMER, TIM_EGR_UG);  // Load the prescaler
+    timer_clear_flag(LCD_WAIT_TIMER, TIM_SR_UIF);
+    timer_enable_irq(LCD_WAIT_TIMER, TIM_DIER_UIE);
+    nvic_enable_irq(NVIC_TIM4_IRQ);
 }
 
 /**
  * @brief Initializes the LCD and configures it for 4-bit mode.
  * 
- * This function sets up the I2C peripheral, initializes the LCD, and configures its
- * display settings (e.g., 2-line display, no cursor blinking). The LCD is cleared after initialization.
+ * This function sets up the I2C peripheral and the wait timer, and queues the
+ * power-on wait, the 4-bit initialisation by instruction (datasheet figure 24) and
+ * the display settings (e.g., 2-line display, no cursor blinking). The LCD is cleared
+ * after initialization. It returns without waiting for any of it.
+ *
+ * Requires `systick_setup()` and `timebase_init()`.
  */
 void lcd_init(void) {
-    systick_setup();
-
-    rcc_periph_clock_enable(RCC_GPIOB);
-    rcc_periph_clock_enable(RCC_I2C1);
-
-    gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, SDA_PIN | SCL_PIN);
+    i2c_bus_init();
+    lcd_wait_timer_setup();
+    lcd_busy_poll = LCD_BUSY_POLL;
+    lcd_poll_failures = 0;
 
-    i2c_peripheral_disable(I2C1);
-    i2c_set_standard_mode(I2C1);
-    i2c_set_clock_frequency(I2C1, 36);
-    i2c_set_trise(I2C1, 36);
-    i2c_set_ccr(I2C1, 180);
-    i2c_peripheral_enable(I2C1);
-
-    delay_ms(50);
+    lcd_enqueue(0, LCD_OP_WAIT, LCD_T_POWER_ON_US);
+    lcd_queue_init_sequence();
+}
 
-    lcd_send_nibble(0x30, 0);
-    delay_ms(5);
-    lcd_send_nibble(0x30, 0);
-    delay_ms(5);
-    lcd_send_nibble(0x30, 0);
-    delay_ms(5);
-    lcd_send_nibble(0x20, 0);
-    delay_ms(5);
+/**
+ * @brief Queues the 4-bit initialisation and the display settings, then a clear.
+ *
+ * Three 0x30 nibbles bring the controller to 8-bit mode from any state, including a
+ * half-received byte in 4-bit mode, so the sequence also resynchronises a running LCD.
+ */
+static void lcd_queue_init_sequence(void) {
+    lcd_send_nibble(0x30, 0, LCD_T_INIT1_US);
+    lcd_send_nibble(0x30, 0, LCD_T_INIT2_US);
+    lcd_send_nibble(0x30, 0, LCD_T_EXEC_US);
+    lcd_send_nibble(0x20, 0, LCD_T_EXEC_US);
 
     lcd_send_byte(LCD_FUNCTIONSET | LCD_2LINE | LCD_5x8DOTS | LCD_4BITMODE, 0);
     lcd_send_byte(LCD_DISPLAYCONTROL | LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF, 0);
     lcd_send_byte(LCD_ENTRYMODESET | LCD_ENTRYLEFT, 0);
-    lcd_send_byte(LCD_CLEARDISPLAY, 0);
-    delay_ms(2);
+    lcd_clear();
 }
 
 /**
- * @brief Prints a single character to the LCD at the current cursor position.
+ * @brief Queues a single character for the current cursor position.
  * 
  * @param c The character to print.
  */
@@ -102,24 +470,37 @@ void lcd_print_char(char c) {
 }
 
 /**
- * @brief Prints a string to the LCD starting at the current cursor position.
+ * @brief Queues a string starting at the current cursor position.
+ * 
+ * The string is dropped whole if the queue cannot take all of it, so a line is
+ * never left half-written.
  * 
  * @param str The null-terminated string to print.
  */
 void lcd_print_string(const char* str) {
+    uint16_t length = 0;
+
+    while (str[length]) {
+        length++;
+    }
+    if (length > lcd_queue_free()) {
+        lcd_overflows += length;
+        return;
+    }
     while (*str) {
-        lcd_print_char(*str++);
+        lcd_enqueue((uint8_t)*str++, LCD_RS, LCD_T_EXEC_US + LCD_T_ADD_US);
     }
+    lcd_kick();
 }
 
 /**
  * @brief Clears the LCD display.
  * 
- * Sends the `LCD_CLEARDISPLAY` command to the LCD to clear its contents.
+ * Queues the `LCD_CLEARDISPLAY` command, followed by the longer wait it needs.
  */
 void lcd_clear(void) {
-    lcd_send_byte(LCD_CLEARDISPLAY, 0);
-    delay_ms(2);
+    lcd_enqueue(LCD_CLEARDISPLAY, 0, LCD_T_CLEAR_US);
+    lcd_kick();
 }
 
 /**
@@ -132,34 +513,138 @@ void lcd_clear(void) {
  * @param col The column number (0 to max column of the display).
  */
 void lcd_set_cursor(uint8_t row, uint8_t col) {
-    uint8_t address;
+    if (row >= LCD_ROWS || col >= lcd_cols) {
+        return;
+    }
+    lcd_send_byte(LCD_SETDDRAMADDR | (lcd_row_address[row] + col), 0);
+}
+
+/*
+ * Display backend (display.h). The framebuffer diffing is done by the display layer;
+ * the backend turns each run into one `LCD_SETDDRAMADDR` and its characters.
+ */
 
-    switch (row) {
-        case 0: address = 0x00 + col; break;
-        case 1: address = 0x40 + col; break;
-        case 2: address = 0x14 + col; break;
-        case 3: address = 0x54 + col; break;
-        default: return;
+/**
+ * @brief Queues a run of characters at a cell, all or nothing.
+ *
+ * @return 1 if queued, 0 if the queue had no room for it.
+ */
+static uint8_t lcd_write_run(uint8_t row, uint8_t col, const char *text, uint8_t length) {
+    if (row >= LCD_ROWS || col + length > lcd_cols) {
+        return 1;  // Off screen: nothing to show
+    }
+    if (lcd_queue_free() < (uint16_t)length + 1) {
+        return 0;
     }
+    lcd_enqueue(LCD_SETDDRAMADDR | (lcd_row_address[row] + col), 0, LCD_T_EXEC_US);
+    for (uint8_t i = 0; i < length; i++) {
+        lcd_enqueue((uint8_t)text[i], LCD_RS, LCD_T_EXEC_US + LCD_T_ADD_US);
+    }
+    return 1;
+}
 
-    lcd_send_byte(LCD_SETDDRAMADDR | address, 0);
+/**
+ * @brief Queues a cursor move.
+ *
+ * @return 1 if queued.
+ */
+static uint8_t lcd_backend_set_cursor(uint8_t row, uint8_t col) {
+    if (row >= LCD_ROWS || col >= lcd_cols || lcd_queue_free() == 0) {
+        return 0;
+    }
+    lcd_set_cursor(row, col);
+    return 1;
 }
 
 /**
- * @brief Delays the execution for a specified number of milliseconds.
- * 
- * @param ms The number of milliseconds to delay.
+ * @brief Reinitialises the LCD after a failed transaction, once the queue has drained.
+ *
+ * @return 1 if the initialisation sequence was queued.
  */
+static uint8_t lcd_recover(void) {
+    if (lcd_fault && lcd_is_idle()) {
+        lcd_fault = 0;
+        lcd_queue_init_sequence();
+        return 1;
+    }
+    return 0;
+}
 
-void delay_ms(uint32_t ms)
-{
-    uint32_t start = sys_milis;
-    while ((sys_milis - start) < ms) {
-        // Wait for the specified time to elapse
-        __asm__("nop");
+/**
+ * @brief Queues the CGRAM upload of a glyph: `LCD_SETCGRAMADDR` and eight rows.
+ *
+ * It leaves the address counter in CGRAM, which is harmless because every run starts
+ * with its own `LCD_SETDDRAMADDR`.
+ *
+ * @return 1 if queued, 0 if the queue had no room for it.
+ */
+static uint8_t lcd_define_glyph(uint8_t slot, const uint8_t rows[DISPLAY_GLYPH_ROWS]) {
+    if (lcd_queue_free() < DISPLAY_GLYPH_ROWS + 1) {
+        return 0;
+    }
+    lcd_enqueue(LCD_SETCGRAMADDR | ((slot & 0x07) << 3), 0, LCD_T_EXEC_US);
+    for (uint8_t row = 0; row < DISPLAY_GLYPH_ROWS; row++) {
+        lcd_enqueue(rows[row] & 0x1F, LCD_RS, LCD_T_EXEC_US + LCD_T_ADD_US);
     }
+    return 1;
 }
 
+/**
+ * @brief Selects the 16x4 row addresses and initialises the LCD.
+ */
+static void lcd_init_16x4(void) {
+    lcd_row_address = lcd_rows_16x4;
+    lcd_cols = 16;
+    lcd_init();
+}
+
+/**
+ * @brief Selects the 20x4 row addresses and initialises the LCD.
+ */
+static void lcd_init_20x4(void) {
+    lcd_row_address = lcd_rows_20x4;
+    lcd_cols = 20;
+    lcd_init();
+}
+
+const display_driver_t lcd_display_16x4 = {
+    {LCD_ROWS, 16, DISPLAY_CAP_GLYPHS},
+    lcd_init_16x4,
+    lcd_write_run,
+    lcd_backend_set_cursor,
+    lcd_kick,
+    lcd_recover,
+    lcd_define_glyph,
+};
+
+const display_driver_t lcd_display_20x4 = {
+    {LCD_ROWS, 20, DISPLAY_CAP_GLYPHS},
+    lcd_init_20x4,
+    lcd_write_run,
+    lcd_backend_set_cursor,
+    lcd_kick,
+    lcd_recover,
+    lcd_define_glyph,
+};
+
+uint8_t lcd_is_idle(void) {
+    return !lcd_running && lcd_head == lcd_tail;
+}
+
+uint16_t lcd_queue_free(void) {
+    return (uint16_t)((lcd_tail + LCD_QUEUE_SIZE - lcd_head - 1) % LCD_QUEUE_SIZE);
+}
+
+uint32_t lcd_get_overflows(void) {
+    return lcd_overflows;
+}
+
+lcd_busy_stats_t lcd_get_busy_stats(void) {
+    lcd_busy_stats_t copy = lcd_busy_stats;
+
+    copy.active = lcd_busy_poll;
+    return copy;
+}
 
 void systick_setup(void)
 {
@@ -180,6 +665,9 @@ void sys_tick_handler(void)
 {
     // Increment the millisecond counter
     sys_milis++;
+
+    // Abort an I2C transaction stuck past its deadline
+    i2c_bus_poll();
 }
 
 
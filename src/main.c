@@ -3,17 +3,33 @@
  * @brief Main program for system initialization and LCD control.
  *
  * This program initializes the system, sets up peripherals like GPIO, ADC, DMA, timers, and interrupts,
- * and continuously updates values to interact with the LCD or other peripherals.
+ * then hands over to the cooperative scheduler, which runs each activity as its own task.
  */
 
 #include "refresh.h"
 
+/**
+ * @brief Task table, highest priority first.
+ *
+ * - metering: processes each ADC block and integrates the meter seconds.
+ * - protection: LED warning level from the current of the block just processed.
+ * - display: page button and display pages; also woken by the button edge, and by the
+ *   backend once it has room for what the display had no room for.
+ * - logging: saves the learned appliance signatures to flash when due.
+ */
+static const sched_task_t tasks[] = {
+    {"metering", metering_poll, 0, TASK_BLOCK_DEADLINE_MS, 0, SCHED_EVENT_ADC_BLOCK},
+    {"protection", adjust_led_intensity, 0, TASK_BLOCK_DEADLINE_MS, 1, SCHED_EVENT_ADC_BLOCK},
+    {"display", ui_poll, TASK_DISPLAY_PERIOD_MS, UI_REFRESH_MS, 2, SCHED_EVENT_BUTTON | SCHED_EVENT_I2C},
+    {"logging", nilm_save_poll, TASK_LOGGING_PERIOD_MS, TASK_LOGGING_PERIOD_MS, 3, 0},
+};
+
 /**
  * @brief Main entry point of the program.
  *
  * This function performs the initial setup of the system, including initializing peripherals
- * such as GPIO, ADC with DMA, timers, external interrupts, and the LCD. Once initialized, it enters
- * an infinite loop to repeatedly update values.
+ * such as GPIO, ADC with DMA, timers, external interrupts, and the LCD. Once initialized, it runs
+ * the task table forever.
  * 
  * @return Always returns 0 (success).
  */
@@ -22,15 +38,28 @@ int main(void) {
     system_init();        /* Initialize system clock and basic configuration. */
     gpio_setup();         /* Configure GPIO pins for input/output as required. */
     config_adc_dma();     /* Set up ADC with DMA for continuous data acquisition. */
-    TMR_setup_PF();       /* Configure periodic timer for regular updates. */
+#if PHASE_SOURCE != PHASE_SOURCE_SAMPLES
+    TMR_setup_PF();       /* Configure Timer 2 input capture for phase shift measurement. */
+#endif
     TMR_setup_pwm();      /* Configure a timer for PWM signal generation. */
-    EXTI_setup_PF();      /* Set up external interrupts for specific GPIO pins. */
-    lcd_init();           /* Initialize the LCD display for interaction. */
+    systick_setup();      /* 1 ms tick: sys_milis, scheduler and I2C deadlines. */
+    timebase_init();      /* DWT cycle counter for microsecond waits and task timing. */
+    display_init();       /* Initialize the DISPLAY_BACKEND display (16x4 LCD by default). */
+    ui_init();            /* Display pages; the button on PB12 selects the page. */
+    demand_init(DEMAND_DEFAULT_BLOCK_S, DEMAND_DEFAULT_SUBINTERVAL_S, DEMAND_DEFAULT_SUBINTERVALS); /* 15 min block and rolling demand. */
+    tariff_init();        /* Time-of-use schedule: valley 00-07 h, peak 18-23 h, rest otherwise. */
+    tariff_set_price(TARIFF_BAND_REST, TARIFF_PRICE_REST);
+    tariff_set_price(TARIFF_BAND_VALLEY, TARIFF_PRICE_VALLEY);
+    tariff_set_price(TARIFF_BAND_PEAK, TARIFF_PRICE_PEAK);
+    tariff_set_band(0 * 60, 7 * 60, TARIFF_BAND_VALLEY);
+    tariff_set_band(18 * 60, 23 * 60, TARIFF_BAND_PEAK);
+    metering_init();      /* Wall clock on the battery-backed RTC; starts the billing period. */
+    stats_init(STATS_DEFAULT_PERIOD_S); /* Min/max/mean/variance and P50/P95/P99 per minute. */
+    nilm_init();          /* Appliance event detector; reloads the learned signatures from flash. */
 
-    // Main loop
-    while (TRUE) {
-        update_values();  /* Continuously update values based on inputs or system state. */
-    }
+    // Tasks are released by their periods and by the DMA, EXTI and I2C interrupts
+    sched_init(tasks, sizeof(tasks) / sizeof(tasks[0]));
+    sched_run();
 
     return 0; // Should never be reached
 }
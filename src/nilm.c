@@ -0,0 +1,348 @@
+/**
+ * @file nilm.c
+ * @brief Implementation of the NILM-lite appliance event detector.
+ *
+ * The steady-state detector keeps the last `NILM_WINDOW_CYCLES` cycles of P and Q in a
+ * ring. A window is steady when its P spread stays inside `NILM_STEADY_BAND_W`; the
+ * difference between consecutive steady means is the event signature.
+ *
+ * @note This file should be used in conjunction with its header file `nilm.h`.
+ */
+
+#include "nilm.h"
+#include "libopencm3/stm32/flash.h"
+
+/**
+ * @brief Flash image of the learned table.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    nilm_class_t classes[NILM_MAX_CLASSES];
+    uint32_t checksum;
+} nilm_flash_image_t;
+
+/** @brief Learned classes. */
+static nilm_class_t classes[NILM_MAX_CLASSES];
+
+/** @brief Energy attributed to each class in mWs. */
+static uint64_t class_energy[NILM_MAX_CLASSES];
+
+/** @brief Number of valid classes. */
+static uint8_t class_count = 0;
+
+/** @brief Ring of per-cycle active power. */
+static float window_p[NILM_WINDOW_CYCLES];
+
+/** @brief Ring of per-cycle reactive power. */
+static float window_q[NILM_WINDOW_CYCLES];
+
+/** @brief Next ring slot to be written. */
+static uint8_t window_index = 0;
+
+/** @brief Number of valid ring slots. */
+static uint8_t window_filled = 0;
+
+/** @brief Active power of the last accepted steady state. */
+static float baseline_p = 0;
+
+/** @brief Reactive power of the last accepted steady state. */
+static float baseline_q = 0;
+
+/** @brief Non-zero once a first steady state has been seen. */
+static uint8_t baseline_valid = 0;
+
+/** @brief Events detected since start-up. */
+static uint32_t event_count = 0;
+
+/** @brief Non-zero when the table differs from the flash copy. */
+static uint8_t table_dirty = 0;
+
+/** @brief Seconds since the table was last written. */
+static uint32_t seconds_since_save = 0;
+
+/**
+ * @brief Absolute value of a float.
+ */
+static float nilm_absf(float x) {
+    return (x < 0) ? -x : x;
+}
+
+/**
+ * @brief Match tolerance for a class signature component.
+ *
+ * @param signature Signature value of the class.
+ * @return Tolerance in the same unit.
+ */
+static float match_tolerance(float signature) {
+    float tol = nilm_absf(signature) * NILM_MATCH_REL;
+    return (tol > NILM_MATCH_ABS_W) ? tol : NILM_MATCH_ABS_W;
+}
+
+/**
+ * @brief Finds the class closest to a signature, within tolerance.
+ *
+ * @param dp Active power step in W (positive).
+ * @param dq Reactive power step in var.
+ * @param only_on Only consider classes currently running.
+ * @return Class index, or -1 if no class matches.
+ */
+static int find_class(float dp, float dq, uint8_t only_on) {
+    int best = -1;
+    float best_distance = 0;
+
+    for (uint8_t i = 0; i < class_count; i++) {
+        if (only_on && !classes[i].on) {
+            continue;
+        }
+        float ep = nilm_absf(dp - classes[i].delta_p_w);
+        float eq = nilm_absf(dq - classes[i].delta_q_var);
+        if (ep > match_tolerance(classes[i].delta_p_w) || eq > match_tolerance(classes[i].delta_q_var)) {
+            continue;
+        }
+        if (best < 0 || ep + eq < best_distance) {
+            best = i;
+            best_distance = ep + eq;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Allocates a class for a new signature, recycling the least matched one when full.
+ *
+ * @return Index of the class slot to use.
+ */
+static uint8_t allocate_class(void) {
+    if (class_count < NILM_MAX_CLASSES) {
+        return class_count++;
+    }
+
+    uint8_t victim = 0;
+    for (uint8_t i = 1; i < NILM_MAX_CLASSES; i++) {
+        if (!classes[i].on && (classes[victim].on || classes[i].matches < classes[victim].matches)) {
+            victim = i;
+        }
+    }
+    class_energy[victim] = 0;
+    return victim;
+}
+
+/**
+ * @brief Handles a step event between two steady states.
+ *
+ * @param dp Active power step in W.
+ * @param dq Reactive power step in var.
+ */
+static void handle_event(float dp, float dq) {
+    event_count++;
+
+    if (dp > 0) {
+        int c = find_class(dp, dq, 0);
+        if (c < 0) {
+            c = allocate_class();
+            classes[c].delta_p_w = dp;
+            classes[c].delta_q_var = dq;
+            classes[c].matches = 1;
+        } else {
+            // Running mean, limited so the centroid can still follow slow drift
+            uint16_t weight = (classes[c].matches < NILM_LEARN_CAP) ? classes[c].matches : NILM_LEARN_CAP;
+            classes[c].delta_p_w += (dp - classes[c].delta_p_w) / (float)(weight + 1);
+            classes[c].delta_q_var += (dq - classes[c].delta_q_var) / (float)(weight + 1);
+            if (classes[c].matches < UINT16_MAX) {
+                classes[c].matches++;
+            }
+        }
+        classes[c].on = 1;
+        table_dirty = 1;
+    } else {
+        int c = find_class(-dp, -dq, 1);
+        if (c >= 0) {
+            classes[c].on = 0;
+        }
+    }
+}
+
+/**
+ * @brief Computes the checksum of a flash image (every word before the checksum).
+ *
+ * @param image Image to check.
+ * @return Checksum value.
+ */
+static uint32_t image_checksum(const nilm_flash_image_t *image) {
+    const uint32_t *word = (const uint32_t *)image;
+    uint32_t sum = 0x5A5A5A5AUL;
+
+    for (uint32_t i = 0; i < (sizeof(nilm_flash_image_t) / 4) - 1; i++) {
+        sum = (sum << 1 | sum >> 31) ^ word[i];
+    }
+    return sum;
+}
+
+/**
+ * @brief Loads the learned table from flash if a valid image is present.
+ */
+static void load_table(void) {
+    const nilm_flash_image_t *image = (const nilm_flash_image_t *)NILM_FLASH_PAGE_ADDR;
+
+    class_count = 0;
+    if (image->magic != NILM_FLASH_MAGIC || image->count > NILM_MAX_CLASSES ||
+        image->checksum != image_checksum(image)) {
+        return;
+    }
+    for (uint8_t i = 0; i < image->count; i++) {
+        classes[i] = image->classes[i];
+        classes[i].on = 0;
+    }
+    class_count = (uint8_t)image->count;
+}
+
+/**
+ * @brief Erases the table page and programs a new image.
+ *
+ * @param image Image to program.
+ */
+static void write_image(const nilm_flash_image_t *image) {
+    const uint32_t *word = (const uint32_t *)image;
+
+    flash_unlock();
+    flash_erase_page(NILM_FLASH_PAGE_ADDR);
+    for (uint32_t i = 0; i < sizeof(nilm_flash_image_t) / 4; i++) {
+        flash_program_word(NILM_FLASH_PAGE_ADDR + i * 4, word[i]);
+    }
+    flash_lock();
+}
+
+void nilm_init(void) {
+    for (uint8_t i = 0; i < NILM_MAX_CLASSES; i++) {
+        class_energy[i] = 0;
+    }
+    window_index = 0;
+    window_filled = 0;
+    baseline_valid = 0;
+    event_count = 0;
+    table_dirty = 0;
+    seconds_since_save = 0;
+    load_table();
+}
+
+void nilm_process_cycle(float p_w, float q_var) {
+    window_p[window_index] = p_w;
+    window_q[window_index] = q_var;
+    window_index = (window_index + 1) % NILM_WINDOW_CYCLES;
+    if (window_filled < NILM_WINDOW_CYCLES) {
+        window_filled++;
+        return;
+    }
+
+    float min_p = window_p[0];
+    float max_p = window_p[0];
+    float sum_p = 0;
+    float sum_q = 0;
+    for (uint8_t i = 0; i < NILM_WINDOW_CYCLES; i++) {
+        if (window_p[i] < min_p) min_p = window_p[i];
+        if (window_p[i] > max_p) max_p = window_p[i];
+        sum_p += window_p[i];
+        sum_q += window_q[i];
+    }
+
+    // Still in a transient: wait for the load to settle
+    if ((max_p - min_p) > NILM_STEADY_BAND_W) {
+        return;
+    }
+
+    float steady_p = sum_p / NILM_WINDOW_CYCLES;
+    float steady_q = sum_q / NILM_WINDOW_CYCLES;
+
+    if (!baseline_valid) {
+        baseline_p = steady_p;
+        baseline_q = steady_q;
+        baseline_valid = 1;
+        return;
+    }
+
+    float dp = steady_p - baseline_p;
+    if (nilm_absf(dp) >= NILM_STEP_THRESHOLD_W) {
+        handle_event(dp, steady_q - baseline_q);
+        baseline_p = steady_p;
+        baseline_q = steady_q;
+    } else {
+        // Follow slow drift of the background load
+        baseline_p += dp / 16;
+        baseline_q += (steady_q - baseline_q) / 16;
+    }
+}
+
+void nilm_tick_second(void) {
+    for (uint8_t i = 0; i < class_count; i++) {
+        if (classes[i].on && classes[i].delta_p_w > 0) {
+            class_energy[i] += (uint64_t)(classes[i].delta_p_w * 1000.0f);
+        }
+    }
+
+    seconds_since_save++;
+}
+
+void nilm_save_poll(void) {
+    if (table_dirty && seconds_since_save >= NILM_SAVE_INTERVAL_S) {
+        nilm_save();
+    }
+}
+
+uint8_t nilm_get_class_count(void) {
+    return class_count;
+}
+
+nilm_class_t nilm_get_class(uint8_t index) {
+    nilm_class_t empty = {0, 0, 0, 0};
+
+    if (index >= class_count) {
+        return empty;
+    }
+    return classes[index];
+}
+
+float nilm_get_class_kwh(uint8_t index) {
+    if (index >= class_count) {
+        return 0;
+    }
+    return (float)class_energy[index] / 3600000000.0f;
+}
+
+uint32_t nilm_get_event_count(void) {
+    return event_count;
+}
+
+void nilm_save(void) {
+    static nilm_flash_image_t image;
+
+    if (!table_dirty) {
+        return;
+    }
+
+    image.magic = NILM_FLASH_MAGIC;
+    image.count = class_count;
+    for (uint8_t i = 0; i < NILM_MAX_CLASSES; i++) {
+        if (i < class_count) {
+            image.classes[i] = classes[i];
+            image.classes[i].on = 0;
+        } else {
+            nilm_class_t empty = {0, 0, 0, 0};
+            image.classes[i] = empty;
+        }
+    }
+    image.checksum = image_checksum(&image);
+
+    write_image(&image);
+    table_dirty = 0;
+    seconds_since_save = 0;
+}
+
+void nilm_forget(void) {
+    for (uint8_t i = 0; i < NILM_MAX_CLASSES; i++) {
+        class_energy[i] = 0;
+    }
+    class_count = 0;
+    table_dirty = 1;
+    nilm_save();
+}
@@ -8,78 +8,316 @@
 
 #include "refresh.h"
 #include "lcd.h"
-#include "stdio.h"
 #include "timer_exti.h"
+#include <math.h>
+
+/** @brief Meter clock in seconds since start-up. */
+static uint32_t meter_seconds = 0;
+
+/** @brief SysTick time at which the current meter second started. */
+static uint32_t meter_second_start = 0;
+
+/** @brief Energy integrated block by block and not pushed yet, in mWs. */
+static float energy_pending_mws = 0;
+
+/** @brief ADC blocks lost at the last integrated block. */
+static uint32_t lost_blocks_seen = 0;
+
+/** @brief Day number of the wall clock the billing period started on. */
+static uint32_t billing_start_day = 0;
+
+/** @brief Results of the last processed ADC block. */
+static metering_snapshot_t metering_results = {0, 0, 0, 0, 0, 0, 0};
+
+/** @brief Waveform shape metrics of each ADC channel. */
+static waveform_metrics_t waveform[ADC_CHANNEL_COUNT];
+
+/** @brief Volts per ADC count on the voltage channel (4096 bits → 230V). */
+#define METER_VOLTAGE_SCALE (230.0f / 4096.0f)
+
+/** @brief Amperes per ADC count on the current channel (4096 bits → 10A). */
+#define METER_CURRENT_SCALE (10.0f / 4096.0f)
 
 /**
  * @brief Reads and processes sensor values from the ADC buffer.
  * 
- * Reads ADC samples for the specified channel, calculates the average, and converts
- * the result to a corresponding physical quantity (voltage or current).
+ * Reads the last completed ADC block (one mains cycle) for the specified channel,
+ * removes the DC bias tracked by the zero-crossing detector, calculates the RMS of
+ * what is left and converts it to the corresponding physical quantity (voltage or
+ * current). The same loop tracks the peak and the rectified mean of the AC signal,
+ * from which the channel's waveform metrics (`get_waveform_metrics()`) are refreshed.
+ *
+ * The samples are summed as integers around the whole part of the bias; its fraction
+ * is taken out of the sums afterwards. The peak and the rectified mean are taken in
+ * 1/2^`ZC_BIAS_SHIFT` counts, the resolution of the tracked bias.
  * 
  * @param channel The ADC channel to read:
  *                - `0` for voltage (Volts).
  *                - `1` for current (Amperes).
- * @return The processed sensor value in the corresponding unit.
+ * @return The RMS value in the corresponding unit.
  */
 float get_sensor_values(uint8_t channel) {
-    uint32_t ac = 0;
-
-    // Accumulate ADC samples for the specified channel
-    for (uint8_t i = 0; i < ADC_SAMPLE_COUNT; i++) {
-        ac += ADC_BUFFER[channel + i * ADC_CHANNEL_COUNT]; // Interleaved channel access
-    }
-
-    // Calculate the average value
-    float average = (float)ac / (float)ADC_SAMPLE_COUNT;
+    int32_t ac = 0;
+    uint32_t ac_squares = 0;
+    uint32_t ac_rectified = 0;
+    int32_t peak = 0;
+    float scale;
+    const volatile uint16_t *block = adc_get_latest_block();
 
     // Convert the raw ADC value to a physical quantity
     if (channel == 0) {
-        // Voltage channel: 0 bits → 0V, 4096 bits → 230V
-        return (230.0 / 4096.0) * average;
+        scale = METER_VOLTAGE_SCALE;
     } else if (channel == 1) {
-        // Current channel: 0 bits → 0A, 4096 bits → 10A
-        return (10.0 / 4096.0) * average;
+        scale = METER_CURRENT_SCALE;
+    } else {
+        return 0; // Return 0 for invalid channel
+    }
+
+    float bias = zc_get_bias(channel);
+    int32_t base = (int32_t)bias;
+    float fraction = bias - (float)base;
+    int32_t bias_fine = (int32_t)(bias * (1 << ZC_BIAS_SHIFT));
+
+    // Accumulate the ADC samples around the bias, tracking squares, magnitude and peak on the way
+    for (uint16_t i = 0; i < ADC_SAMPLE_COUNT; i++) {
+        int32_t sample = block[channel + i * ADC_CHANNEL_COUNT]; // Interleaved channel access
+        int32_t ac_sample = sample - base;
+        int32_t magnitude = (sample << ZC_BIAS_SHIFT) - bias_fine;
+        ac += ac_sample;
+        ac_squares += (uint32_t)(ac_sample * ac_sample);
+        if (magnitude < 0) {
+            magnitude = -magnitude;
+        }
+        ac_rectified += (uint32_t)magnitude;
+        if (magnitude > peak) {
+            peak = magnitude;
+        }
     }
 
-    return 0; // Return 0 for invalid channel
+    // Mean square around the exact bias: sum((x - f)^2) = sum(x^2) - 2 f sum(x) + N f^2
+    float mean_square = ((float)ac_squares - 2.0f * fraction * (float)ac) / (float)ADC_SAMPLE_COUNT
+                        + fraction * fraction;
+    float rms = (mean_square > 0) ? sqrtf(mean_square) : 0;
+    float peak_counts = (float)peak * (1.0f / (1 << ZC_BIAS_SHIFT));
+    float rectified = (float)ac_rectified * (1.0f / (1 << ZC_BIAS_SHIFT)) / (float)ADC_SAMPLE_COUNT;
+
+    // Waveform shape of this cycle, plus the max-hold registers
+    waveform_metrics_t *wf = &waveform[channel];
+    wf->peak = scale * peak_counts;
+    wf->rms = scale * rms;
+    wf->crest_factor = (rms > 0) ? peak_counts / rms : 0;
+    wf->form_factor = (rectified > 0) ? rms / rectified : 0;
+    if (wf->peak > wf->peak_hold) {
+        wf->peak_hold = wf->peak;
+    }
+    if (wf->crest_factor > wf->crest_factor_hold) {
+        wf->crest_factor_hold = wf->crest_factor;
+    }
+
+    return scale * rms;
 }
 
 /**
- * @brief Updates the LCD with the latest sensor values and checks for the current value.
- * 
- * Displays voltage, current, power, and phase shift on the LCD across four lines.
- * - Line 1: Voltage (A0 channel).
- * - Line 2: Current (A1 channel).
- * - Line 3: Calculated power (kW).
- * - Line 4: Average phase shift (ms).
+ * @brief Calculates the active power of the last ADC block.
+ *
+ * The mean over the cycle of the instantaneous power, (v - Vbias)(i - Ibias), so the
+ * phase shift and the harmonics are accounted for, unlike Urms * Irms. The bias
+ * fractions are taken out of the integer sums as in `get_sensor_values()`.
+ *
+ * @return Active power in watts (negative when power flows back to the grid).
  */
-void update_values(void) {
-    char line[17];
-    float power = get_sensor_values(0) * get_sensor_values(1);
-
-    // Display voltage on the first line
-    snprintf(line, sizeof(line), "Volt A0: %u V", (unsigned int)get_sensor_values(0));
-    lcd_set_cursor(0, 0);
-    lcd_print_string(line);
-
-    // Display current on the second line
-    snprintf(line, sizeof(line), "Current: %u A", (unsigned int)get_sensor_values(1));
-    lcd_set_cursor(1, 0);
-    lcd_print_string(line);
-
-    // Display power on the third line
-    snprintf(line, sizeof(line), "Power : %u KW", (unsigned int)power);
-    lcd_set_cursor(2, 0);
-    lcd_print_string(line);
-
-    // Display phase shift on the fourth line
-    snprintf(line, sizeof(line), "Phase : %u mS", (unsigned int)(average_phase_shift() / 10));
-    lcd_set_cursor(3, 0);
-    lcd_print_string(line);
-    
-    //Checks current
-    adjust_led_intensity();
+float get_active_power(void) {
+    int32_t v_sum = 0;
+    int32_t i_sum = 0;
+    int64_t products = 0;
+    const volatile uint16_t *block = adc_get_latest_block();
+
+    float v_bias = zc_get_bias(0);
+    float i_bias = zc_get_bias(1);
+    int32_t v_base = (int32_t)v_bias;
+    int32_t i_base = (int32_t)i_bias;
+    float v_fraction = v_bias - (float)v_base;
+    float i_fraction = i_bias - (float)i_base;
+
+    for (uint16_t k = 0; k < ADC_SAMPLE_COUNT; k++) {
+        int32_t v = (int32_t)block[k * ADC_CHANNEL_COUNT] - v_base;
+        int32_t i = (int32_t)block[k * ADC_CHANNEL_COUNT + 1] - i_base;
+        v_sum += v;
+        i_sum += i;
+        products += v * i;
+    }
+
+    // sum((v - fv)(i - fi)) = sum(v i) - fi sum(v) - fv sum(i) + N fv fi
+    float mean = ((float)products - i_fraction * (float)v_sum - v_fraction * (float)i_sum)
+                 / (float)ADC_SAMPLE_COUNT + v_fraction * i_fraction;
+
+    return METER_VOLTAGE_SCALE * METER_CURRENT_SCALE * mean;
+}
+
+/**
+ * @brief Returns the waveform shape metrics of a channel.
+ *
+ * The per-cycle values are those of the last `get_sensor_values()` call on the channel.
+ *
+ * @param channel `0` for voltage, `1` for current.
+ * @return Peak, RMS, crest and form factor, and their max-hold registers.
+ */
+waveform_metrics_t get_waveform_metrics(uint8_t channel) {
+    if (channel >= ADC_CHANNEL_COUNT) {
+        waveform_metrics_t empty = {0, 0, 0, 0, 0, 0};
+        return empty;
+    }
+    return waveform[channel];
+}
+
+/**
+ * @brief Clears the max-hold registers of a channel.
+ *
+ * @param channel `0` for voltage, `1` for current.
+ */
+void reset_waveform_hold(uint8_t channel) {
+    if (channel < ADC_CHANNEL_COUNT) {
+        waveform[channel].peak_hold = 0;
+        waveform[channel].crest_factor_hold = 0;
+    }
+}
+
+/**
+ * @brief Advances the meter clock and pushes the energy of each elapsed second.
+ *
+ * The active power of every ADC block is integrated over the block time into the
+ * pending energy. A block the task skipped, or the ADC lost, is counted at the power
+ * of the block that follows, so the whole time is integrated. Each meter second pushes
+ * the pending energy; if several elapsed at once, it is shared evenly between them.
+ * The last readings also feed one sample per second to the statistics engine.
+ *
+ * Nothing is done until the ADC completes a new block. Each block is one mains cycle:
+ * its results are published to `metering_get_snapshot()`, and the active and reactive
+ * power are passed to the appliance event detector. Once per second the optocoupler
+ * phase is cross-checked against the sample-domain detector when `PHASE_SOURCE` asks
+ * for it.
+ */
+void metering_poll(void) {
+    phase_capture_poll();
+
+    uint32_t block = adc_get_block_count();
+    if (block == metering_results.block) {
+        return;
+    }
+
+    float voltage = get_sensor_values(0);
+    float current = get_sensor_values(1);
+    float power = get_active_power();
+    float phase = average_phase_shift();
+    float angle = phase * ((float)M_PI / 180.0f);
+
+    metering_results.voltage = voltage;
+    metering_results.current = current;
+    metering_results.power = power;
+    metering_results.phase = phase;
+    metering_results.power_factor = cosf(angle);
+    metering_results.frequency = get_line_frequency();
+
+    // Energy of this block and of any block missed since the previous one (imported only)
+    uint32_t lost = adc_get_lost_blocks();
+    uint32_t blocks = (block - metering_results.block) + (lost - lost_blocks_seen);
+    lost_blocks_seen = lost;
+    metering_results.block = block;
+    if (power > 0) {
+        energy_pending_mws += power * METER_BLOCK_MWS_PER_W * (float)blocks;
+    }
+
+    nilm_process_cycle(power, voltage * current * sinf(angle));
+
+    if ((sys_milis - meter_second_start) < METER_SECOND_MS) {
+        return;
+    }
+
+    uint32_t seconds = (sys_milis - meter_second_start) / METER_SECOND_MS;
+    uint32_t energy_mws = (uint32_t)(energy_pending_mws / (float)seconds);
+    energy_pending_mws -= (float)(energy_mws * seconds);  // The fraction carries over
+
+    // One statistics sample per meter second, taken with the energy
+    stats_update(STATS_VOLTAGE, voltage);
+    stats_update(STATS_CURRENT, current);
+    stats_update(STATS_POWER, power);
+    stats_update(STATS_PHASE, phase);
+
+    // Seconds pushed late are billed at the times they elapsed at
+    uint32_t time_of_day = metering_get_time_of_day() + SECONDS_PER_DAY - seconds;
+    for (uint32_t second = 0; second < seconds; second++) {
+        meter_second_start += METER_SECOND_MS;
+        demand_push_second(energy_mws, meter_seconds);
+        tariff_push_energy(energy_mws, (time_of_day + second + 1) % SECONDS_PER_DAY);
+        stats_tick_second();
+        nilm_tick_second();
+        meter_seconds++;
+    }
+
+    if ((rtc_clock_get_day() - billing_start_day) >= tariff_get_billing_days()) {
+        metering_new_billing_period();
+    }
+
+#if PHASE_SOURCE == PHASE_SOURCE_CROSSCHECK
+    zc_crosscheck(phase, get_phase_snapshot().samples);
+#endif
+}
+
+/**
+ * @brief Returns the results of the last processed ADC block.
+ *
+ * @return Latest metering results.
+ */
+metering_snapshot_t metering_get_snapshot(void) {
+    return metering_results;
+}
+
+/**
+ * @brief Returns the meter clock.
+ *
+ * @return Seconds elapsed since start-up, as counted by `metering_poll()`.
+ */
+uint32_t metering_get_seconds(void) {
+    return meter_seconds;
+}
+
+/**
+ * @brief Sets the wall-clock time of day used for the tariff bands.
+ *
+ * @param seconds_of_day Current time in seconds since midnight.
+ */
+void metering_set_time_of_day(uint32_t seconds_of_day) {
+    rtc_clock_set_time_of_day(seconds_of_day);
+}
+
+/**
+ * @brief Returns the wall-clock time of day.
+ *
+ * @return Seconds since midnight.
+ */
+uint32_t metering_get_time_of_day(void) {
+    return rtc_clock_get_time_of_day();
+}
+
+/**
+ * @brief Starts the wall clock and the first billing period.
+ *
+ * The energy registers are not kept over a reset, so the period starts today.
+ */
+void metering_init(void) {
+    rtc_clock_init();
+    billing_start_day = rtc_clock_get_day();
+}
+
+/**
+ * @brief Starts a new billing period.
+ *
+ * Clears the tariff energy registers and the peak demand registers.
+ */
+void metering_new_billing_period(void) {
+    tariff_reset_registers();
+    demand_reset_peaks();
+    billing_start_day = rtc_clock_get_day();
 }
 
 /**
@@ -102,7 +340,7 @@ void set_pwm_duty_cycle(uint16_t duty) {
  * - Sets the LED to maximum intensity for currents exceeding `CURRENT_MAX`.
  */
 void adjust_led_intensity(void) {
-    float current = get_sensor_values(1); // Read current from channel 1
+    float current = metering_results.current; // Current of the last ADC block
 
     if (current < CURRENT_MIN) {
         set_pwm_duty_cycle(0); // Turn LED off
@@ -0,0 +1,40 @@
+/**
+ * @file rtc_clock.c
+ * @brief Battery-backed wall clock on the STM32F1 RTC.
+ */
+
+#include "rtc_clock.h"
+
+/**
+ * @brief Time of day the firmware was built at, from `__TIME__` ("hh:mm:ss").
+ *
+ * @return Seconds since midnight.
+ */
+static uint32_t rtc_clock_build_time(void) {
+    const char *t = __TIME__;
+
+    return ((t[0] - '0') * 10 + (t[1] - '0')) * 3600UL
+           + ((t[3] - '0') * 10 + (t[4] - '0')) * 60UL
+           + (t[6] - '0') * 10 + (t[7] - '0');
+}
+
+void rtc_clock_init(void) {
+    uint8_t running = (RCC_BDCR & RCC_BDCR_RTCEN) != 0;
+
+    rtc_auto_awake(RCC_LSE, RTC_CLOCK_PRESCALER);
+    if (!running) {
+        rtc_set_counter_val(rtc_clock_build_time());
+    }
+}
+
+uint32_t rtc_clock_get_time_of_day(void) {
+    return rtc_get_counter_val() % SECONDS_PER_DAY;
+}
+
+uint32_t rtc_clock_get_day(void) {
+    return rtc_get_counter_val() / SECONDS_PER_DAY;
+}
+
+void rtc_clock_set_time_of_day(uint32_t seconds_of_day) {
+    rtc_set_counter_val(rtc_clock_get_day() * SECONDS_PER_DAY + seconds_of_day % SECONDS_PER_DAY);
+}
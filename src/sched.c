@@ -0,0 +1,264 @@
+/**
+ * @file sched.c
+ * @brief Task release, ready set and dispatch.
+ *
+ * Released tasks are bits of `sched_ready`. Interrupts set them through
+ * `sched_post()`; the dispatcher sets those of due periodic tasks, then clears the
+ * bit of the task it picks before running it, with interrupts masked for both, so an
+ * event posted while a task runs releases it again.
+ *
+ * The idle check and the WFI run with interrupts masked: an interrupt arriving in
+ * between stays pending and wakes the core at once instead of being slept through.
+ * WFI wakes on a pending interrupt even while PRIMASK masks it; the interrupt is taken
+ * as soon as the mask is lifted.
+ */
+
+#include "sched.h"
+#include "lcd.h"
+#include "timebase.h"
+#include "libopencm3/cm3/cortex.h"
+
+/** @brief Task table. */
+static const sched_task_t *sched_tasks = 0;
+
+/** @brief Number of tasks in `sched_tasks`. */
+static uint8_t sched_count = 0;
+
+/** @brief Bit per task: released and waiting to run. */
+static volatile uint32_t sched_ready = 0;
+
+/** @brief SysTick time each released task was released at. */
+static volatile uint32_t sched_release[SCHED_MAX_TASKS];
+
+/** @brief SysTick time of the next periodic release of each task. */
+static uint32_t sched_next[SCHED_MAX_TASKS];
+
+/** @brief Counters of each task. */
+static sched_task_stats_t sched_stats[SCHED_MAX_TASKS];
+
+/** @brief Cycle counter when the core last woke up, or when awake time was last counted. */
+static uint32_t sched_awake;
+
+/** @brief Cycles awake in the current window. */
+static uint32_t sched_busy_cycles = 0;
+
+/** @brief SysTick time the current window started. */
+static uint32_t sched_window_start;
+
+/** @brief Load of the last complete window. */
+static sched_load_t sched_load = {0, 0, 0, 0, 0};
+
+void sched_init(const sched_task_t *tasks, uint8_t count) {
+    uint32_t now = sys_milis;
+
+    if (count > SCHED_MAX_TASKS) {
+        count = SCHED_MAX_TASKS;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        sched_next[i] = now + tasks[i].period_ms;
+        sched_stats[i].runs = 0;
+        sched_stats[i].deadline_misses = 0;
+        sched_stats[i].max_run_us = 0;
+    }
+
+    sched_awake = timebase_cycles();
+    sched_busy_cycles = 0;
+    sched_window_start = now;
+
+    uint32_t primask = cm_mask_interrupts(1);
+    sched_tasks = tasks;
+    sched_count = count;
+    sched_ready = 0;
+    cm_mask_interrupts(primask);
+}
+
+/**
+ * @brief Marks a task released at a SysTick time; interrupts must be masked.
+ */
+static void sched_release_task(uint8_t task, uint32_t release) {
+    uint32_t bit = 1UL << task;
+
+    if (!(sched_ready & bit)) {
+        sched_release[task] = release;
+        sched_ready |= bit;
+    }
+}
+
+void sched_post(uint8_t events) {
+    uint32_t primask = cm_mask_interrupts(1);
+    uint32_t now = sys_milis;
+
+    for (uint8_t i = 0; i < sched_count; i++) {
+        if (sched_tasks[i].events & events) {
+            sched_release_task(i, now);
+        }
+    }
+    cm_mask_interrupts(primask);
+}
+
+/**
+ * @brief Releases the periodic tasks whose period elapsed.
+ *
+ * A task more than one period late skips the periods it missed instead of running
+ * back to back to catch up; each skipped period counts as a deadline miss.
+ */
+static void sched_release_periodic(uint32_t now) {
+    for (uint8_t i = 0; i < sched_count; i++) {
+        uint16_t period = sched_tasks[i].period_ms;
+
+        if (period == 0 || (int32_t)(now - sched_next[i]) < 0) {
+            continue;
+        }
+
+        uint32_t primask = cm_mask_interrupts(1);
+        sched_release_task(i, sched_next[i]);
+        cm_mask_interrupts(primask);
+
+        sched_next[i] += period;
+        if ((int32_t)(now - sched_next[i]) >= 0) {
+            sched_stats[i].deadline_misses += (now - sched_next[i]) / period + 1;
+            sched_next[i] = now + period;
+        }
+    }
+}
+
+/**
+ * @brief Picks the released task of highest priority, earliest deadline on a tie.
+ *
+ * @return Task index, or `SCHED_MAX_TASKS` if none is released.
+ */
+static uint8_t sched_pick(uint32_t ready, uint32_t now) {
+    uint8_t best = SCHED_MAX_TASKS;
+    uint32_t best_slack = 0;
+
+    for (uint8_t i = 0; i < sched_count; i++) {
+        if (!(ready & (1UL << i))) {
+            continue;
+        }
+        // Time left to the deadline; wraps to a huge value once it is missed, so clamp
+        int32_t slack = (int32_t)(sched_release[i] + sched_tasks[i].deadline_ms - now);
+        uint32_t left = slack > 0 ? (uint32_t)slack : 0;
+
+        if (best == SCHED_MAX_TASKS || sched_tasks[i].priority < sched_tasks[best].priority
+            || (sched_tasks[i].priority == sched_tasks[best].priority && left < best_slack)) {
+            best = i;
+            best_slack = left;
+        }
+    }
+    return best;
+}
+
+uint8_t sched_dispatch(void) {
+    uint32_t now = sys_milis;
+    uint32_t released = 0;
+    uint8_t task;
+
+    sched_release_periodic(now);
+
+    uint32_t primask = cm_mask_interrupts(1);
+    task = sched_pick(sched_ready, now);
+    if (task < SCHED_MAX_TASKS) {
+        sched_ready &= ~(1UL << task);
+        released = sched_release[task];
+    }
+    cm_mask_interrupts(primask);
+
+    if (task >= SCHED_MAX_TASKS) {
+        return 0;
+    }
+
+    uint32_t start = timebase_cycles();
+    sched_tasks[task].run();
+    uint32_t run_us = timebase_elapsed_us(start);
+
+    sched_task_stats_t *stats = &sched_stats[task];
+    stats->runs++;
+    if (run_us > stats->max_run_us) {
+        stats->max_run_us = run_us;
+    }
+    if ((sys_milis - released) > sched_tasks[task].deadline_ms) {
+        stats->deadline_misses++;
+    }
+    return 1;
+}
+
+/**
+ * @brief Adds the time awake since the last call to the window, and closes the window once it is over.
+ */
+static void sched_load_update(void) {
+    uint32_t now = timebase_cycles();
+    uint32_t window_ms = sys_milis - sched_window_start;
+
+    sched_busy_cycles += now - sched_awake;
+    sched_awake = now;
+
+    if (window_ms < SCHED_LOAD_WINDOW_MS) {
+        return;
+    }
+    uint32_t window_us = window_ms * 1000;
+    uint32_t busy_us = sched_busy_cycles / TIMEBASE_CYCLES_PER_US;
+
+    if (busy_us > window_us) {
+        busy_us = window_us;  // The window is only known to the millisecond
+    }
+    sched_load.busy_us = busy_us;
+    sched_load.sleep_us = window_us - busy_us;
+    sched_load.load_permille = (uint16_t)((uint64_t)busy_us * 1000 / window_us);
+    if (sched_load.load_permille > sched_load.peak_permille) {
+        sched_load.peak_permille = sched_load.load_permille;
+    }
+    sched_busy_cycles = 0;
+    sched_window_start += window_ms;
+}
+
+/**
+ * @brief Tells whether a periodic task is due.
+ */
+static uint8_t sched_periodic_due(uint32_t now) {
+    for (uint8_t i = 0; i < sched_count; i++) {
+        if (sched_tasks[i].period_ms != 0 && (int32_t)(now - sched_next[i]) >= 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Sleeps until the next interrupt if no task is released or due.
+ *
+ * The time asleep is left out of the window's awake time.
+ */
+static void sched_idle(void) {
+    uint32_t primask = cm_mask_interrupts(1);
+
+    if (sched_ready == 0 && !sched_periodic_due(sys_milis)) {
+        sched_load_update();
+        sched_load.sleeps++;
+#if SCHED_IDLE_SLEEP
+        __asm__ volatile("wfi");
+#endif
+        sched_awake = timebase_cycles();
+    }
+    cm_mask_interrupts(primask);
+}
+
+void sched_run(void) {
+    while (1) {
+        if (!sched_dispatch()) {
+            sched_idle();
+        }
+        sched_load_update();
+    }
+}
+
+sched_load_t sched_get_load(void) {
+    return sched_load;
+}
+
+sched_task_stats_t sched_get_stats(uint8_t task) {
+    if (task >= sched_count) {
+        sched_task_stats_t empty = {0, 0, 0};
+        return empty;
+    }
+    return sched_stats[task];
+}
@@ -0,0 +1,306 @@
+/**
+ * @file ssd1306.c
+ * @brief SSD1306 OLED backend: text rendering into page memory and dirty page push.
+ */
+
+#include "ssd1306.h"
+#include "lcd.h"
+
+/** @brief First character of `ssd1306_font`. */
+#define SSD1306_FONT_FIRST 0x20
+
+/** @brief Last character of `ssd1306_font`. */
+#define SSD1306_FONT_LAST 0x7E
+
+/** @brief Character drawn as a full block. */
+#define SSD1306_FULL_BLOCK 0xFF
+
+/** @brief First character code of the user-defined glyphs. */
+#define SSD1306_GLYPH_BASE 8
+
+/**
+ * @brief 5x7 ASCII font, one byte per column, least significant bit at the top.
+ */
+static const uint8_t ssd1306_font[SSD1306_FONT_LAST - SSD1306_FONT_FIRST + 1][SSD1306_GLYPH_WIDTH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00}, // ' ' ! "
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, // # $ %
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00}, // & ' (
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08}, // ) * +
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00}, // , - .
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, // / 0 1
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10}, // 2 3 4
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03}, // 5 6 7
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00}, // 8 9 :
+    {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14}, // ; < =
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3E}, // > ? @
+    {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22}, // A B C
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01}, // D E F
+    {0x3E, 0x41, 0x49, 0x49, 0x7A}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, // G H I
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40}, // J K L
+    {0x7F, 0x02, 0x0C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E}, // M N O
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46}, // P Q R
+    {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, // S T U
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F}, {0x63, 0x14, 0x08, 0x14, 0x63}, // V W X
+    {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00}, // Y Z [
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04}, // \ ] ^
+    {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78}, // _ ` a
+    {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7F}, // b c d
+    {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E}, // e f g
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3D, 0x00}, // h i j
+    {0x7F, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78}, // k l m
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0x7C, 0x14, 0x14, 0x14, 0x08}, // n o p
+    {0x08, 0x14, 0x14, 0x18, 0x7C}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20}, // q r s
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C}, // t u v
+    {0x3C, 0x40, 0x30, 0x40, 0x3C}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C}, // w x y
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7F, 0x00, 0x00}, // z { |
+    {0x00, 0x41, 0x36, 0x08, 0x00}, {0x10, 0x08, 0x08, 0x10, 0x08},                                  // } ~
+};
+
+/**
+ * @brief Initialisation commands: 128x64, horizontal addressing, charge pump on, display on.
+ */
+static const uint8_t ssd1306_init_commands[] = {
+    SSD1306_CONTROL_COMMAND,
+    0xAE,        // Display off
+    0xD5, 0x80,  // Clock divide ratio and oscillator frequency (reset value)
+    0xA8, 0x3F,  // Multiplex ratio: 64 rows
+    0xD3, 0x00,  // No display offset
+    0x40,        // Start line 0
+    0x8D, 0x14,  // Charge pump on
+    0x20, 0x00,  // Horizontal addressing mode
+    0xA1,        // Column 127 mapped to SEG0 (not mirrored on the usual modules)
+    0xC8,        // COM scan from COM63 (not flipped on the usual modules)
+    0xDA, 0x12,  // COM pins: alternative configuration
+    0x81, 0xCF,  // Contrast
+    0xD9, 0xF1,  // Pre-charge period
+    0xDB, 0x40,  // VCOMH deselect level
+    0xA4,        // Display follows RAM
+    0xA6,        // Normal (not inverted)
+    0xAF,        // Display on
+};
+
+/** @brief Page memory; byte 0 of each page is the data control byte so a page goes out as is. */
+static uint8_t ssd1306_pages[SSD1306_PAGES][1 + SSD1306_WIDTH];
+
+/** @brief Character shown in each cell, to redraw the cells of a redefined glyph. */
+static char ssd1306_text[SSD1306_ROWS][SSD1306_COLS];
+
+/** @brief Column bitmaps of the user-defined glyphs. */
+static uint8_t ssd1306_glyphs[8][SSD1306_GLYPH_WIDTH];
+
+/** @brief Addressing command of the page being pushed. */
+static uint8_t ssd1306_address[7];
+
+/** @brief Bit per page: changed since it was last pushed. */
+static volatile uint8_t ssd1306_dirty = 0;
+
+/** @brief Non-zero until the initialisation commands have been sent. */
+static volatile uint8_t ssd1306_init_pending = 0;
+
+/** @brief Non-zero while the interrupt chain is pushing pages. */
+static volatile uint8_t ssd1306_running = 0;
+
+/** @brief Set by a failed transaction: the display is reinitialised by `ssd1306_recover()`. */
+static volatile uint8_t ssd1306_fault = 0;
+
+/** @brief Page whose data follows its addressing command, or `SSD1306_PAGES` if none. */
+static uint8_t ssd1306_data_page = SSD1306_PAGES;
+
+/** @brief Pages pushed. */
+static uint32_t ssd1306_page_writes = 0;
+
+static void ssd1306_write_done(uint8_t status);
+
+/**
+ * @brief Starts the next transaction of the chain, or ends the chain.
+ *
+ * Runs from the main loop (interrupts masked) or from the I2C completion interrupt.
+ * A page's dirty bit is cleared before its data goes out, so a page written during
+ * the push is simply pushed again.
+ */
+static void ssd1306_next(void) {
+    uint8_t started;
+
+    if (ssd1306_init_pending) {
+        ssd1306_init_pending = 0;
+        started = i2c_bus_write(SSD1306_ADDRESS, ssd1306_init_commands, sizeof(ssd1306_init_commands), ssd1306_write_done);
+    } else if (ssd1306_data_page < SSD1306_PAGES) {
+        uint8_t page = ssd1306_data_page;
+        ssd1306_data_page = SSD1306_PAGES;
+        ssd1306_dirty &= (uint8_t)~(1U << page);
+        ssd1306_page_writes++;
+        started = i2c_bus_write(SSD1306_ADDRESS, ssd1306_pages[page], sizeof(ssd1306_pages[page]), ssd1306_write_done);
+    } else if (ssd1306_dirty) {
+        uint8_t page = 0;
+        while (!(ssd1306_dirty & (1U << page))) {
+            page++;
+        }
+        ssd1306_address[0] = SSD1306_CONTROL_COMMAND;
+        ssd1306_address[1] = 0x21;  // Column range
+        ssd1306_address[2] = 0;
+        ssd1306_address[3] = SSD1306_WIDTH - 1;
+        ssd1306_address[4] = 0x22;  // Page range
+        ssd1306_address[5] = page;
+        ssd1306_address[6] = page;
+        ssd1306_data_page = page;
+        started = i2c_bus_write(SSD1306_ADDRESS, ssd1306_address, sizeof(ssd1306_address), ssd1306_write_done);
+    } else {
+        started = 0;
+    }
+
+    if (!started) {
+        ssd1306_running = 0;
+    }
+}
+
+/**
+ * @brief I2C completion callback: continues the chain, or stops it on an error.
+ *
+ * @param status I2C result.
+ */
+static void ssd1306_write_done(uint8_t status) {
+    if (status != I2C_BUS_OK) {
+        ssd1306_fault = 1;
+        ssd1306_data_page = SSD1306_PAGES;
+        ssd1306_running = 0;
+        return;
+    }
+    ssd1306_next();
+}
+
+/**
+ * @brief Starts the chain if it is not running and there is something to send.
+ */
+static void ssd1306_kick(void) {
+    uint32_t primask = cm_mask_interrupts(1);
+
+    if (!ssd1306_running && (ssd1306_init_pending || ssd1306_dirty)) {
+        ssd1306_running = 1;
+        ssd1306_next();
+    }
+    cm_mask_interrupts(primask);
+}
+
+/**
+ * @brief Draws a character into its cell of the page memory.
+ */
+static void ssd1306_draw_cell(uint8_t row, uint8_t col, char c) {
+    uint8_t *cell = &ssd1306_pages[row][1 + col * SSD1306_CELL_WIDTH];
+    uint8_t code = (uint8_t)c;
+
+    for (uint8_t x = 0; x < SSD1306_GLYPH_WIDTH; x++) {
+        if (code >= SSD1306_FONT_FIRST && code <= SSD1306_FONT_LAST) {
+            cell[x] = ssd1306_font[code - SSD1306_FONT_FIRST][x];
+        } else if (code >= SSD1306_GLYPH_BASE && code < SSD1306_GLYPH_BASE + 8) {
+            cell[x] = ssd1306_glyphs[code - SSD1306_GLYPH_BASE][x];
+        } else if (code == SSD1306_FULL_BLOCK) {
+            cell[x] = 0xFF;
+        } else {
+            cell[x] = 0x00;
+        }
+    }
+    cell[SSD1306_GLYPH_WIDTH] = 0x00;
+    ssd1306_text[row][col] = c;
+    ssd1306_dirty |= (uint8_t)(1U << row);
+}
+
+/**
+ * @brief Clears the page memory and queues the initialisation and a full push.
+ *
+ * Requires `systick_setup()` and `timebase_init()`.
+ */
+static void ssd1306_init(void) {
+    i2c_bus_init();
+
+    for (uint8_t row = 0; row < SSD1306_ROWS; row++) {
+        ssd1306_pages[row][0] = SSD1306_CONTROL_DATA;
+        for (uint8_t col = 0; col < SSD1306_COLS; col++) {
+            ssd1306_draw_cell(row, col, ' ');
+        }
+        for (uint8_t x = 1 + SSD1306_COLS * SSD1306_CELL_WIDTH; x <= SSD1306_WIDTH; x++) {
+            ssd1306_pages[row][x] = 0x00;  // The two columns right of the last cell
+        }
+    }
+    ssd1306_init_pending = 1;
+    ssd1306_dirty = 0xFF;
+}
+
+/**
+ * @brief Renders a run of characters; never runs out of room.
+ */
+static uint8_t ssd1306_write_run(uint8_t row, uint8_t col, const char *text, uint8_t length) {
+    for (uint8_t i = 0; i < length && row < SSD1306_ROWS && col + i < SSD1306_COLS; i++) {
+        ssd1306_draw_cell(row, col + i, text[i]);
+    }
+    return 1;
+}
+
+/**
+ * @brief The OLED has no text cursor: text only reaches it through runs.
+ *
+ * @return 0.
+ */
+static uint8_t ssd1306_set_cursor(uint8_t row, uint8_t col) {
+    (void)row;
+    (void)col;
+    return 0;
+}
+
+/**
+ * @brief Resends the initialisation and every page after a failed transaction.
+ *
+ * The page memory still holds the whole screen, so the display layer has nothing to
+ * redraw.
+ *
+ * @return 0.
+ */
+static uint8_t ssd1306_recover(void) {
+    if (ssd1306_fault && !ssd1306_running) {
+        ssd1306_fault = 0;
+        ssd1306_init_pending = 1;
+        ssd1306_dirty = 0xFF;
+    }
+    return 0;
+}
+
+/**
+ * @brief Stores a glyph as columns and redraws the cells showing it.
+ *
+ * @return 1.
+ */
+static uint8_t ssd1306_define_glyph(uint8_t slot, const uint8_t rows[DISPLAY_GLYPH_ROWS]) {
+    char code = (char)(SSD1306_GLYPH_BASE + (slot & 0x07));
+
+    for (uint8_t x = 0; x < SSD1306_GLYPH_WIDTH; x++) {
+        uint8_t column = 0;
+        for (uint8_t y = 0; y < DISPLAY_GLYPH_ROWS; y++) {
+            if (rows[y] & (0x10 >> x)) {
+                column |= (uint8_t)(1U << y);
+            }
+        }
+        ssd1306_glyphs[slot & 0x07][x] = column;
+    }
+
+    for (uint8_t row = 0; row < SSD1306_ROWS; row++) {
+        for (uint8_t col = 0; col < SSD1306_COLS; col++) {
+            if (ssd1306_text[row][col] == code) {
+                ssd1306_draw_cell(row, col, code);
+            }
+        }
+    }
+    return 1;
+}
+
+const display_driver_t ssd1306_display = {
+    {SSD1306_ROWS, SSD1306_COLS, DISPLAY_CAP_GLYPHS},
+    ssd1306_init,
+    ssd1306_write_run,
+    ssd1306_set_cursor,
+    ssd1306_kick,
+    ssd1306_recover,
+    ssd1306_define_glyph,
+};
+
+uint32_t ssd1306_get_page_writes(void) {
+    return ssd1306_page_writes;
+}
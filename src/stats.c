@@ -0,0 +1,278 @@
+/**
+ * @file stats.c
+ * @brief Implementation of the streaming statistics engine.
+ *
+ * Quantiles use the P² algorithm (Jain & Chlamtac): five markers track the minimum,
+ * p/2, p, (1+p)/2 and the maximum, and the middle markers are nudged towards their
+ * desired positions with a piecewise-parabolic prediction after each sample.
+ *
+ * @note This file should be used in conjunction with its header file `stats.h`.
+ */
+
+#include "stats.h"
+
+/** @brief Number of quantiles estimated per quantity. */
+#define STATS_QUANTILE_COUNT 3
+
+/**
+ * @brief P² single-quantile estimator.
+ */
+typedef struct {
+    float q[STATS_P2_MARKERS];   /**< Marker heights. */
+    int32_t n[STATS_P2_MARKERS]; /**< Actual marker positions. */
+    float np[STATS_P2_MARKERS];  /**< Desired marker positions. */
+    uint32_t count;              /**< Samples seen. */
+} p2_estimator_t;
+
+/**
+ * @brief Running accumulators of one quantity.
+ */
+typedef struct {
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+    float m2;  /**< Sum of squared deviations from the mean (Welford). */
+    p2_estimator_t quantile[STATS_QUANTILE_COUNT];
+} stats_accumulator_t;
+
+/** @brief Quantile probabilities, in the order of the result fields. */
+static const float quantile_p[STATS_QUANTILE_COUNT] = {0.50f, 0.95f, 0.99f};
+
+/** @brief Accumulators of the period in progress. */
+static stats_accumulator_t running[STATS_QUANTITY_COUNT];
+
+/** @brief Results of the last completed period. */
+static stats_result_t published[STATS_QUANTITY_COUNT];
+
+/** @brief Period length in seconds. */
+static uint32_t period_length_s = STATS_DEFAULT_PERIOD_S;
+
+/** @brief Seconds elapsed in the current period. */
+static uint32_t period_elapsed_s = 0;
+
+/**
+ * @brief Resets a P² estimator.
+ *
+ * @param est Estimator to reset.
+ */
+static void p2_reset(p2_estimator_t *est) {
+    est->count = 0;
+}
+
+/**
+ * @brief Adds a sample to a P² estimator.
+ *
+ * @param est Estimator to update.
+ * @param p Probability of the estimated quantile.
+ * @param x New sample.
+ */
+static void p2_add(p2_estimator_t *est, float p, float x) {
+    float *q = est->q;
+    int32_t *n = est->n;
+    int k;
+
+    // The first five samples seed the markers
+    if (est->count < STATS_P2_MARKERS) {
+        q[est->count] = x;
+        est->count++;
+        if (est->count == STATS_P2_MARKERS) {
+            for (int i = 1; i < STATS_P2_MARKERS; i++) {
+                float v = q[i];
+                int j = i - 1;
+                while (j >= 0 && q[j] > v) {
+                    q[j + 1] = q[j];
+                    j--;
+                }
+                q[j + 1] = v;
+            }
+            for (int i = 0; i < STATS_P2_MARKERS; i++) {
+                n[i] = i;
+            }
+            est->np[0] = 0;
+            est->np[1] = 2 * p;
+            est->np[2] = 4 * p;
+            est->np[3] = 2 + 2 * p;
+            est->np[4] = 4;
+        }
+        return;
+    }
+
+    // Find the cell the sample falls in, extending the extremes if needed
+    if (x < q[0]) {
+        q[0] = x;
+        k = 0;
+    } else if (x >= q[4]) {
+        q[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= q[k + 1]) {
+            k++;
+        }
+    }
+
+    for (int i = k + 1; i < STATS_P2_MARKERS; i++) {
+        n[i]++;
+    }
+    est->np[1] += p / 2;
+    est->np[2] += p;
+    est->np[3] += (1 + p) / 2;
+    est->np[4] += 1;
+
+    // Move the middle markers towards their desired positions
+    for (int i = 1; i <= 3; i++) {
+        float d = est->np[i] - (float)n[i];
+
+        if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)) {
+            int s = (d >= 0) ? 1 : -1;
+            float parabolic = q[i] + (float)s / (float)(n[i + 1] - n[i - 1]) *
+                ((float)(n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (float)(n[i + 1] - n[i]) +
+                 (float)(n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (float)(n[i] - n[i - 1]));
+
+            if (q[i - 1] < parabolic && parabolic < q[i + 1]) {
+                q[i] = parabolic;
+            } else {
+                q[i] += (float)s * (q[i + s] - q[i]) / (float)(n[i + s] - n[i]);
+            }
+            n[i] += s;
+        }
+    }
+    est->count++;
+}
+
+/**
+ * @brief Reads the current estimate of a P² estimator.
+ *
+ * With fewer than five samples the nearest-rank value of the seeds is returned.
+ *
+ * @param est Estimator to read.
+ * @param p Probability of the estimated quantile.
+ * @return Quantile estimate.
+ */
+static float p2_get(const p2_estimator_t *est, float p) {
+    if (est->count >= STATS_P2_MARKERS) {
+        return est->q[2];
+    }
+    if (est->count == 0) {
+        return 0;
+    }
+
+    float sorted[STATS_P2_MARKERS];
+    for (uint32_t i = 0; i < est->count; i++) {
+        float v = est->q[i];
+        int j = (int)i - 1;
+        while (j >= 0 && sorted[j] > v) {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+    return sorted[(uint32_t)(p * (float)(est->count - 1) + 0.5f)];
+}
+
+/**
+ * @brief Resets the accumulators of one quantity.
+ *
+ * @param acc Accumulators to reset.
+ */
+static void accumulator_reset(stats_accumulator_t *acc) {
+    acc->count = 0;
+    acc->min = 0;
+    acc->max = 0;
+    acc->mean = 0;
+    acc->m2 = 0;
+    for (int i = 0; i < STATS_QUANTILE_COUNT; i++) {
+        p2_reset(&acc->quantile[i]);
+    }
+}
+
+/**
+ * @brief Builds a result set from the accumulators of one quantity.
+ *
+ * @param acc Accumulators to read.
+ * @return Statistics of the samples accumulated so far.
+ */
+static stats_result_t accumulator_result(const stats_accumulator_t *acc) {
+    stats_result_t result;
+
+    result.count = acc->count;
+    result.min = acc->min;
+    result.max = acc->max;
+    result.mean = acc->mean;
+    result.variance = (acc->count > 0) ? acc->m2 / (float)acc->count : 0;
+    result.p50 = p2_get(&acc->quantile[0], quantile_p[0]);
+    result.p95 = p2_get(&acc->quantile[1], quantile_p[1]);
+    result.p99 = p2_get(&acc->quantile[2], quantile_p[2]);
+    return result;
+}
+
+void stats_init(uint32_t period_s) {
+    stats_result_t empty = {0, 0, 0, 0, 0, 0, 0, 0};
+
+    for (int i = 0; i < STATS_QUANTITY_COUNT; i++) {
+        published[i] = empty;
+    }
+    stats_set_period(period_s);
+}
+
+void stats_set_period(uint32_t period_s) {
+    period_length_s = (period_s != 0) ? period_s : STATS_DEFAULT_PERIOD_S;
+    period_elapsed_s = 0;
+    for (int i = 0; i < STATS_QUANTITY_COUNT; i++) {
+        accumulator_reset(&running[i]);
+    }
+}
+
+void stats_update(stats_quantity_t quantity, float value) {
+    if (quantity >= STATS_QUANTITY_COUNT) {
+        return;
+    }
+    stats_accumulator_t *acc = &running[quantity];
+
+    if (acc->count == 0) {
+        acc->min = value;
+        acc->max = value;
+    } else if (value < acc->min) {
+        acc->min = value;
+    } else if (value > acc->max) {
+        acc->max = value;
+    }
+
+    // Welford's update keeps the variance numerically stable in single precision
+    acc->count++;
+    float delta = value - acc->mean;
+    acc->mean += delta / (float)acc->count;
+    acc->m2 += delta * (value - acc->mean);
+
+    for (int i = 0; i < STATS_QUANTILE_COUNT; i++) {
+        p2_add(&acc->quantile[i], quantile_p[i], value);
+    }
+}
+
+void stats_tick_second(void) {
+    period_elapsed_s++;
+    if (period_elapsed_s < period_length_s) {
+        return;
+    }
+
+    for (int i = 0; i < STATS_QUANTITY_COUNT; i++) {
+        published[i] = accumulator_result(&running[i]);
+        accumulator_reset(&running[i]);
+    }
+    period_elapsed_s = 0;
+}
+
+stats_result_t stats_get_result(stats_quantity_t quantity) {
+    if (quantity >= STATS_QUANTITY_COUNT) {
+        quantity = STATS_VOLTAGE;
+    }
+    return published[quantity];
+}
+
+stats_result_t stats_get_running(stats_quantity_t quantity) {
+    if (quantity >= STATS_QUANTITY_COUNT) {
+        quantity = STATS_VOLTAGE;
+    }
+    return accumulator_result(&running[quantity]);
+}
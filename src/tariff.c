@@ -0,0 +1,126 @@
+/**
+ * @file tariff.c
+ * @brief Implementation of the time-of-use tariff engine.
+ *
+ * Band lookup is a single index into `slot_band`, which is rebuilt only when the
+ * schedule changes. Energy is kept per band in exact integer milliwatt-seconds;
+ * cost is derived from those registers on read, so no rounding accumulates.
+ *
+ * @note This file should be used in conjunction with its header file `tariff.h`.
+ */
+
+#include "tariff.h"
+
+/** @brief Band assigned to each slot of the day. */
+static uint8_t slot_band[TARIFF_SLOTS_PER_DAY];
+
+/** @brief Price per kWh of each band. */
+static float band_price[TARIFF_MAX_BANDS];
+
+/** @brief Energy registered in each band in mWs. */
+static uint64_t band_energy[TARIFF_MAX_BANDS];
+
+/** @brief Seconds registered in the current billing period. */
+static uint32_t period_elapsed_s = 0;
+
+/** @brief Billing period length in seconds. */
+static uint32_t period_length_s = TARIFF_DEFAULT_BILLING_DAYS * SECONDS_PER_DAY;
+
+/** @brief Band the last second was billed at. */
+static uint8_t active_band = 0;
+
+void tariff_init(void) {
+    for (uint16_t i = 0; i < TARIFF_SLOTS_PER_DAY; i++) {
+        slot_band[i] = 0;
+    }
+    for (uint8_t b = 0; b < TARIFF_MAX_BANDS; b++) {
+        band_price[b] = 0;
+    }
+    period_length_s = TARIFF_DEFAULT_BILLING_DAYS * SECONDS_PER_DAY;
+    tariff_reset_registers();
+}
+
+void tariff_set_price(uint8_t band, float price_per_kwh) {
+    if (band < TARIFF_MAX_BANDS) {
+        band_price[band] = price_per_kwh;
+    }
+}
+
+void tariff_set_band(uint16_t start_min, uint16_t end_min, uint8_t band) {
+    if (band >= TARIFF_MAX_BANDS) {
+        return;
+    }
+
+    uint16_t slot = (uint16_t)((start_min * 60UL / TARIFF_SLOT_S) % TARIFF_SLOTS_PER_DAY);
+    uint16_t end = (uint16_t)((end_min * 60UL / TARIFF_SLOT_S) % TARIFF_SLOTS_PER_DAY);
+
+    // Walk the slots forward, wrapping over midnight when end <= start
+    do {
+        slot_band[slot] = band;
+        slot++;
+        if (slot >= TARIFF_SLOTS_PER_DAY) {
+            slot = 0;
+        }
+    } while (slot != end);
+}
+
+void tariff_set_billing_days(uint8_t days) {
+    if (days != 0) {
+        period_length_s = days * SECONDS_PER_DAY;
+    }
+}
+
+uint8_t tariff_get_billing_days(void) {
+    return (uint8_t)(period_length_s / SECONDS_PER_DAY);
+}
+
+void tariff_push_energy(uint32_t energy_mws, uint32_t time_of_day_s) {
+    active_band = slot_band[(time_of_day_s % SECONDS_PER_DAY) / TARIFF_SLOT_S];
+    band_energy[active_band] += energy_mws;
+    period_elapsed_s++;
+}
+
+uint8_t tariff_get_active_band(void) {
+    return active_band;
+}
+
+float tariff_get_band_kwh(uint8_t band) {
+    if (band >= TARIFF_MAX_BANDS) {
+        return 0;
+    }
+    return (float)band_energy[band] / TARIFF_MWS_PER_KWH;
+}
+
+float tariff_get_total_kwh(void) {
+    uint64_t total = 0;
+
+    for (uint8_t b = 0; b < TARIFF_MAX_BANDS; b++) {
+        total += band_energy[b];
+    }
+    return (float)total / TARIFF_MWS_PER_KWH;
+}
+
+float tariff_get_cost(void) {
+    float cost = 0;
+
+    for (uint8_t b = 0; b < TARIFF_MAX_BANDS; b++) {
+        cost += tariff_get_band_kwh(b) * band_price[b];
+    }
+    return cost;
+}
+
+float tariff_get_projected_cost(void) {
+    float cost = tariff_get_cost();
+
+    if (period_elapsed_s == 0 || period_elapsed_s >= period_length_s) {
+        return cost;
+    }
+    return cost * ((float)period_length_s / (float)period_elapsed_s);
+}
+
+void tariff_reset_registers(void) {
+    for (uint8_t b = 0; b < TARIFF_MAX_BANDS; b++) {
+        band_energy[b] = 0;
+    }
+    period_elapsed_s = 0;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file timebase.c
+ * @brief Microsecond timebase, deadlines and delays on the DWT cycle counter.
+ */
+
+#include "timebase.h"
+
+void timebase_init(void) {
+    dwt_enable_cycle_counter();
+}
+
+uint32_t timebase_cycles(void) {
+    return dwt_read_cycle_counter();
+}
+
+timebase_deadline_t timebase_deadline_us(uint32_t us) {
+    return dwt_read_cycle_counter() + us * TIMEBASE_CYCLES_PER_US;
+}
+
+uint8_t timebase_expired(timebase_deadline_t deadline) {
+    return (int32_t)(dwt_read_cycle_counter() - deadline) >= 0;
+}
+
+uint32_t timebase_elapsed_us(uint32_t start) {
+    return (dwt_read_cycle_counter() - start) / TIMEBASE_CYCLES_PER_US;
+}
+
+void delay_us(uint32_t us) {
+    timebase_deadline_t deadline = timebase_deadline_us(us);
+
+    while (!timebase_expired(deadline)) {
+    }
+}
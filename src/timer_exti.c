@@ -2,22 +2,360 @@
  * @file timer_exti.c
  * @brief Implementation of timer and external interrupt (EXTI) configurations and functions.
  * 
- * This file provides the initialization and setup of timers and EXTI for phase shift measurement,
- * including PWM generation, EXTI configuration, and phase shift calculation.
+ * This file provides the initialization and setup of timers for phase shift measurement,
+ * including PWM generation, input capture of the zero-crossing edges, and phase shift calculation.
  * 
  * @note This file should be used in conjunction with its header file `timer_exti.h`.
  */
 
 #include "timer_exti.h"
+#include "lcd.h"
 
-/** @brief Buffer to store phase shift values for averaging. */
-static volatile uint32_t phase_shift_buffer[N_PHASE_SHIFT];
+/** @brief Ring of the last phase angle samples (Q15 turns), owned by the capture path. */
+static int16_t phase_shift_buffer[N_PHASE_SHIFT];
 
-/** @brief Counter to track the number of stored phase shifts. */
-static volatile uint32_t counter = 0;
+/** @brief Next slot of `phase_shift_buffer` to be written. */
+static uint8_t phase_shift_index = 0;
 
-/** @brief Calculated phase shift average. */
-static volatile uint32_t phase_shift = 0;
+/** @brief Running sum of `phase_shift_buffer`, owned by the capture path. */
+static int32_t phase_shift_sum = 0;
+
+/** @brief Number of valid samples in `phase_shift_buffer`. */
+static uint16_t phase_shift_count = 0;
+
+/** @brief Total phase shift samples taken, owned by the capture path. */
+static uint32_t phase_shift_samples = 0;
+
+/** @brief Output of `PHASE_FILTER`, owned by the capture path. */
+static int16_t phase_shift_filtered = 0;
+
+#if PHASE_FILTER == PHASE_FILTER_EMA
+/** @brief EMA state as a 32-bit fraction of a turn; the top 16 bits are the Q15 angle. */
+static uint32_t phase_shift_ema = 0;
+#elif PHASE_FILTER == PHASE_FILTER_MEDIAN
+/** @brief Offsets of the samples of `phase_shift_buffer` from the median reference, in ascending order. */
+static int16_t phase_shift_sorted[N_PHASE_SHIFT];
+#else
+/** @brief Length of the unit vectors summed by the mean filter. */
+#define PHASE_VECTOR_SCALE 16384.0f
+
+/** @brief Running sum of the cosines of `phase_shift_buffer`, in 1/`PHASE_VECTOR_SCALE`. */
+static int32_t phase_shift_cos_sum = 0;
+
+/** @brief Running sum of the sines of `phase_shift_buffer`, in 1/`PHASE_VECTOR_SCALE`. */
+static int32_t phase_shift_sin_sum = 0;
+#endif
+
+/** @brief Seqlock sequence: odd while `phase_published` is being written. */
+static volatile uint32_t phase_sequence = 0;
+
+/** @brief Phase shift snapshot published to the readers. */
+static volatile phase_snapshot_t phase_published = {0, 0, 0, 0, 0};
+
+/** @brief Timer 2 timestamp of the last accepted voltage zero-crossing edge. */
+static volatile uint16_t voltage_edge = 0;
+
+/** @brief Non-zero once `voltage_edge` holds a valid capture. */
+static volatile uint8_t voltage_edge_valid = 0;
+
+/** @brief Non-zero while the last voltage edge has not been paired with a current edge. */
+static volatile uint8_t voltage_edge_fresh = 0;
+
+/** @brief Timer 2 timestamp of the last accepted current zero-crossing edge. */
+static volatile uint16_t current_edge = 0;
+
+/** @brief Non-zero once `current_edge` holds a valid capture. */
+static volatile uint8_t current_edge_valid = 0;
+
+/** @brief Ticks between the last two voltage edges (one mains period). */
+static volatile uint16_t cycle_period = (uint16_t)(TM2_TICK_HZ / 50);
+
+/** @brief Non-zero while `cycle_period` is trusted as the expected period. */
+static volatile uint8_t period_locked = 0;
+
+/** @brief Non-zero once `cycle_period` was measured, until the voltage edges stop. */
+static volatile uint8_t period_valid = 0;
+
+/** @brief Voltage edges accepted as references since start-up. */
+static volatile uint32_t voltage_edge_count = 0;
+
+/** @brief Consecutive voltage intervals that had to be resynchronised. */
+static volatile uint8_t resync_count = 0;
+
+/** @brief Edge and sample rejection counters. */
+static volatile phase_diagnostics_t diagnostics = {0, 0, 0};
+
+#if PHASE_CAPTURE_DMA
+/** @brief Circular DMA buffer of (voltage, current) capture pairs written by Timer 2 bursts. */
+static volatile uint16_t capture_stream[PHASE_STREAM_WORDS];
+
+/** @brief Next word of `capture_stream` to be consumed by `phase_capture_poll()`. */
+static uint16_t stream_read_index = 0;
+
+/** @brief Completed DMA passes over `capture_stream`, counted by the transfer-complete interrupt. */
+static volatile uint32_t stream_laps = 0;
+
+/** @brief Value `stream_laps` had when the DMA wrote the word at `stream_read_index`. */
+static uint32_t stream_read_laps = 0;
+
+/** @brief `voltage_edge_count` at the last check of `phase_capture_poll()`. */
+static uint32_t voltage_edges_checked = 0;
+
+/** @brief SysTick time `voltage_edge_count` last moved. */
+static uint32_t voltage_edge_seen_ms = 0;
+#endif
+
+/** @brief Edge interval shorter than the expected period: spurious edge. */
+#define EDGE_GLITCH 0
+
+/** @brief Edge interval matching the expected period. */
+#define EDGE_VALID 1
+
+/** @brief Edge interval longer than the expected period: one or more edges missed. */
+#define EDGE_MISSED 2
+
+/**
+ * @brief Classifies the interval between two edges of the same signal.
+ *
+ * Once locked, the interval must be within 1/2^`PHASE_PERIOD_TOL_SHIFT` of the tracked
+ * period; before that, within the `PHASE_PERIOD_MIN`..`PHASE_PERIOD_MAX` mains range.
+ *
+ * @param interval Ticks since the previous accepted edge.
+ * @return `EDGE_GLITCH`, `EDGE_VALID` or `EDGE_MISSED`.
+ */
+static uint8_t edge_classify(uint16_t interval) {
+    uint16_t low = PHASE_PERIOD_MIN;
+    uint16_t high = PHASE_PERIOD_MAX;
+
+    if (period_locked) {
+        uint16_t tolerance = cycle_period >> PHASE_PERIOD_TOL_SHIFT;
+        low = cycle_period - tolerance;
+        high = cycle_period + tolerance;
+    }
+
+    if (interval < low) {
+        return EDGE_GLITCH;
+    }
+    return (interval <= high) ? EDGE_VALID : EDGE_MISSED;
+}
+
+/**
+ * @brief Estimates how many edges were skipped in an over-long interval.
+ *
+ * @param interval Ticks since the previous accepted edge (modulo 2^16).
+ * @return Number of missed edges, at least one.
+ */
+static uint32_t edges_missed(uint16_t interval) {
+    uint32_t periods = ((uint32_t)interval + cycle_period / 2) / cycle_period;
+    return (periods > 1) ? periods - 1 : 1;
+}
+
+/**
+ * @brief Registers a voltage zero-crossing timestamp and updates the cycle period.
+ *
+ * Edges arriving too early are glitches and are dropped without moving the reference.
+ * Edges arriving too late mean edges were missed: they are counted and the reference
+ * is resynchronised without touching the period, which is unlocked after
+ * `PHASE_RELOCK_EDGES` consecutive resyncs.
+ *
+ * @param timestamp Timer 2 capture of the voltage edge.
+ */
+static void voltage_edge_add(uint16_t timestamp) {
+    if (voltage_edge_valid) {
+        uint16_t interval = (uint16_t)(timestamp - voltage_edge); // Modulo 2^16 difference
+
+        if (interval == 0) {
+            return;  // Same capture seen again: no new voltage edge since the last pair
+        }
+        switch (edge_classify(interval)) {
+            case EDGE_GLITCH:
+                diagnostics.rejected_edges++;
+                return;
+            case EDGE_VALID:
+                cycle_period = interval;
+                period_locked = 1;
+                period_valid = 1;
+                resync_count = 0;
+                break;
+            default:
+                diagnostics.missed_edges += edges_missed(interval);
+                if (++resync_count >= PHASE_RELOCK_EDGES) {
+                    period_locked = 0;
+                }
+                break;
+        }
+    }
+    voltage_edge = timestamp;
+    voltage_edge_valid = 1;
+    voltage_edge_fresh = 1;
+    voltage_edge_count++;
+}
+
+/**
+ * @brief Publishes the phase shift state to the readers.
+ *
+ * Single writer (the capture ISR, or the main loop in DMA mode). The sequence is odd
+ * while the fields are written, so a reader that overlaps the update retries instead
+ * of seeing a torn snapshot. The writer never waits.
+ *
+ * @param last Most recent phase angle sample (Q15 turns).
+ */
+static void phase_publish(int16_t last) {
+    phase_sequence++;
+    __dmb();
+    phase_published.sum = phase_shift_sum;
+    phase_published.count = phase_shift_count;
+    phase_published.last = last;
+    phase_published.filtered = phase_shift_filtered;
+    phase_published.samples = phase_shift_samples;
+    __dmb();
+    phase_sequence++;
+}
+
+#if PHASE_FILTER == PHASE_FILTER_MEAN
+/**
+ * @brief Adds the unit vector of an angle to the running sums of the mean filter.
+ *
+ * The components are rounded to integers, so removing an angle later takes out
+ * exactly what adding it put in and the sums never drift.
+ *
+ * @param angle Angle in Q15 turns.
+ * @param sign `1` to add the vector, `-1` to remove it.
+ */
+static void phase_vector_add(int16_t angle, int32_t sign) {
+    float radians = (float)angle * ((float)M_PI / 32768.0f);
+
+    phase_shift_cos_sum += sign * (int32_t)lrintf(cosf(radians) * PHASE_VECTOR_SCALE);
+    phase_shift_sin_sum += sign * (int32_t)lrintf(sinf(radians) * PHASE_VECTOR_SCALE);
+}
+#endif
+
+/**
+ * @brief Updates `phase_shift_filtered` with a new sample.
+ *
+ * Called after the sample entered the ring (`phase_shift_count` already counts it).
+ * - Mean: circular mean, the direction of the sum of the samples' unit vectors,
+ *   kept as running sums, O(1). An arithmetic mean of angles near +/-180 deg (e.g. a
+ *   reversed CT) would average to about 0 deg.
+ * - EMA: the state is a 32-bit fraction of a turn moved by the wrapped 16-bit
+ *   difference, so it follows the angle across +/-180 deg, O(1).
+ * - Median: taken over the wrapped 16-bit offsets of the samples from the previous
+ *   output, which is added back afterwards, so a window straddling +/-180 deg (e.g. a
+ *   reversed CT) is ordered around its own centre instead of being split at the wrap.
+ *   The offsets move with the reference, so they are re-sorted on every sample
+ *   (insertion sort, `N_PHASE_SHIFT` is small). An even count returns the mean of the
+ *   two middle offsets.
+ *
+ * @param sample New angle in Q15 turns.
+ * @param evicted Angle it replaced in the ring.
+ * @param full Non-zero if the ring was full, i.e. `evicted` is a real sample.
+ */
+static void phase_filter_update(int16_t sample, int16_t evicted, uint8_t full) {
+#if PHASE_FILTER == PHASE_FILTER_EMA
+    (void)evicted;
+    (void)full;
+    if (phase_shift_samples == 0) {
+        phase_shift_ema = (uint32_t)(uint16_t)sample << 16;
+    } else {
+        int16_t difference = (int16_t)(uint16_t)(sample - (int16_t)(phase_shift_ema >> 16));
+        phase_shift_ema += (uint32_t)((int32_t)difference * (1 << (16 - PHASE_EMA_SHIFT)));
+    }
+    phase_shift_filtered = (int16_t)(phase_shift_ema >> 16);
+#elif PHASE_FILTER == PHASE_FILTER_MEDIAN
+    (void)evicted;
+    (void)full;
+    int16_t reference = (phase_shift_samples == 0) ? sample : phase_shift_filtered;
+    uint16_t count = phase_shift_count;  // The ring fills from index 0
+    int32_t median;
+
+    for (uint16_t k = 0; k < count; k++) {
+        int16_t offset = (int16_t)(uint16_t)(phase_shift_buffer[k] - reference);
+        uint16_t i = k;
+        while (i > 0 && phase_shift_sorted[i - 1] > offset) {
+            phase_shift_sorted[i] = phase_shift_sorted[i - 1];
+            i--;
+        }
+        phase_shift_sorted[i] = offset;
+    }
+
+    if (count & 1U) {
+        median = phase_shift_sorted[count / 2];
+    } else {
+        median = ((int32_t)phase_shift_sorted[count / 2 - 1] + phase_shift_sorted[count / 2]) / 2;
+    }
+    phase_shift_filtered = (int16_t)(uint16_t)(reference + median);
+#else
+    if (full) {
+        phase_vector_add(evicted, -1);
+    }
+    phase_vector_add(sample, 1);
+    float direction = atan2f((float)phase_shift_sin_sum, (float)phase_shift_cos_sum);
+    phase_shift_filtered = (int16_t)(uint16_t)(int32_t)lrintf(direction * (32768.0f / (float)M_PI));
+#endif
+}
+
+/**
+ * @brief Registers a current zero-crossing timestamp as a phase shift sample.
+ *
+ * The edge is gated like the voltage edges. The sample is only taken if a voltage
+ * edge was accepted since the previous current edge and it is shorter than one period,
+ * so stale or implausible samples never reach the averaging buffer.
+ *
+ * The delay is normalised to the measured period as a fraction of a turn in Q15
+ * (65536 = 360 deg). Storing it in 16 bits wraps delays over half a period to negative
+ * angles, which pairs the current edge with the nearest voltage edge: positive angles
+ * are a lagging (inductive) current, negative ones a leading (capacitive) current.
+ *
+ * Replaces the oldest sample of the ring, updates the running sum and runs
+ * `PHASE_FILTER`, so the filtered angle is refreshed on every edge without gaps.
+ *
+ * @param timestamp Timer 2 capture of the current edge.
+ */
+static void current_edge_add(uint16_t timestamp) {
+    if (current_edge_valid) {
+        uint16_t interval = (uint16_t)(timestamp - current_edge); // Modulo 2^16 difference
+
+        switch (edge_classify(interval)) {
+            case EDGE_GLITCH:
+                diagnostics.rejected_edges++;
+                return;
+            case EDGE_MISSED:
+                diagnostics.missed_edges += edges_missed(interval);
+                break;
+            default:
+                break;
+        }
+    }
+    current_edge = timestamp;
+    current_edge_valid = 1;
+
+    uint16_t delay = (uint16_t)(timestamp - voltage_edge); // Modulo 2^16 difference
+    if (!voltage_edge_fresh || delay >= cycle_period) {
+        diagnostics.rejected_samples++;
+        return;
+    }
+    voltage_edge_fresh = 0;
+
+    int16_t sample = (int16_t)(uint16_t)(((uint32_t)delay << 16) / cycle_period);
+    int16_t evicted = phase_shift_buffer[phase_shift_index];
+    uint8_t full = (phase_shift_count >= N_PHASE_SHIFT);
+
+    if (full) {
+        phase_shift_sum -= evicted;
+    } else {
+        phase_shift_count++;
+    }
+    phase_shift_buffer[phase_shift_index] = sample;
+    phase_shift_sum += sample;
+    phase_shift_index++;
+    if (phase_shift_index >= N_PHASE_SHIFT) {
+        phase_shift_index = 0;
+    }
+    phase_filter_update(sample, evicted, full);
+    phase_shift_samples++;
+
+    phase_publish(sample);
+}
 
 /**
  * @brief Initializes the system clock and enables peripheral clocks.
@@ -37,7 +375,7 @@ void system_init(void) {
 /**
  * @brief Configures GPIO pins for input and output functionality.
  * 
- * - Configures EXTI_PORT pins as input with pull-up/down resistors for interrupts.
+ * - Configures EXTI_PORT pins as input with pull-up/down resistors for Timer 2 input capture.
  * - Configures GPIOA pin 10 as an alternate function output for PWM.
  */
 void gpio_setup(void) {
@@ -48,12 +386,49 @@ void gpio_setup(void) {
 /**
  * @brief Configures Timer 2 for phase shift measurement.
  * 
- * Timer 2 is set to count upwards with a prescaler for a resolution of 0.1 ms.
+ * Timer 2 free-runs over its full 16-bit range with a resolution of 1 us. The voltage
+ * and current optocoupler edges are latched by input capture channels 3 (PA2) and 4 (PA3),
+ * so the timer hardware timestamps them and the counter is never reset by software.
+ * The input digital filter drops pulses shorter than a few microseconds before capture.
  */
 void TMR_setup_PF(void) {
     rcc_periph_reset_pulse(RST_TIM2);
     timer_set_prescaler(TIM2, PREESCALER_TM2 - 1);
+    timer_set_period(TIM2, PERIOD_TM2);
     timer_direction_up(TIM2);
+
+    // CH3 captures TI3 (voltage edge), CH4 captures TI4 (current edge), rising edge
+    timer_ic_set_input(TIM2, TIM_IC3, TIM_IC_IN_TI3);
+    timer_ic_set_input(TIM2, TIM_IC4, TIM_IC_IN_TI4);
+    timer_ic_set_filter(TIM2, TIM_IC3, PHASE_IC_FILTER);
+    timer_ic_set_filter(TIM2, TIM_IC4, PHASE_IC_FILTER);
+    timer_ic_enable(TIM2, TIM_IC3);
+    timer_ic_enable(TIM2, TIM_IC4);
+
+#if PHASE_CAPTURE_DMA
+    // Each CC4 request bursts CCR3 and CCR4 through DMAR into the stream: one pair per cycle
+    rcc_periph_clock_enable(RCC_DMA1);
+    dma_channel_reset(DMA1, PHASE_DMA_CHANNEL);
+    dma_set_priority(DMA1, PHASE_DMA_CHANNEL, DMA_CCR_PL_HIGH);
+    dma_set_peripheral_address(DMA1, PHASE_DMA_CHANNEL, (uint32_t)&TIM_DMAR(TIM2));
+    dma_set_memory_address(DMA1, PHASE_DMA_CHANNEL, (uint32_t)capture_stream);
+    dma_set_number_of_data(DMA1, PHASE_DMA_CHANNEL, PHASE_STREAM_WORDS);
+    dma_set_memory_size(DMA1, PHASE_DMA_CHANNEL, DMA_CCR_MSIZE_16BIT);
+    dma_set_peripheral_size(DMA1, PHASE_DMA_CHANNEL, DMA_CCR_PSIZE_16BIT);
+    dma_enable_circular_mode(DMA1, PHASE_DMA_CHANNEL);
+    dma_enable_memory_increment_mode(DMA1, PHASE_DMA_CHANNEL);
+    dma_set_read_from_peripheral(DMA1, PHASE_DMA_CHANNEL);
+    dma_enable_transfer_complete_interrupt(DMA1, PHASE_DMA_CHANNEL);
+    nvic_enable_irq(NVIC_DMA1_CHANNEL7_IRQ);
+    dma_enable_channel(DMA1, PHASE_DMA_CHANNEL);
+
+    TIM_DCR(TIM2) = TIM2_DCR_DBL_BURST | TIM2_DCR_DBA_CCR3;
+    timer_enable_irq(TIM2, TIM_DIER_CC4DE);
+#else
+    timer_enable_irq(TIM2, TIM_DIER_CC3IE | TIM_DIER_CC4IE);
+    nvic_enable_irq(NVIC_TIM2_IRQ);
+#endif
+    timer_enable_counter(TIM2);
 }
 
 /**
@@ -66,65 +441,216 @@ void TMR_setup_pwm(void) {
     timer_disable_counter(TIM1);
     timer_set_mode(TIM1, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
     timer_set_prescaler(TIM1, PREESCALER_TM1 - 1);
-    timer_set_period(TIM1, PERIOD_TM1);
+    timer_set_period(TIM1, PWM_PERIOD_TM1);
     timer_set_oc_mode(TIM1, TIM_OC3, TIM_OCM_PWM1);
     timer_enable_oc_output(TIM1, TIM_OC3);
     timer_enable_break_main_output(TIM1);
     timer_enable_counter(TIM1);
 }
 
+#if !PHASE_CAPTURE_DMA
 /**
- * @brief Configures EXTI lines for phase shift measurement.
+ * @brief Timer 2 interrupt service routine (ISR).
  * 
- * - Enables interrupts for EXTI2 and EXTI3.
- * - Configures rising edge trigger for EXTI2 and EXTI3.
+ * - Counts captures lost to overcapture.
+ * - On a voltage edge (CC3), keeps the captured timestamp.
+ * - On a current edge (CC4), adds the phase shift sample.
  */
-void EXTI_setup_PF(void) {
-    nvic_enable_irq(NVIC_EXTI2_IRQ);
-    nvic_enable_irq(NVIC_EXTI3_IRQ);
-    exti_select_source(EXTI2 | EXTI3, EXTI_PORT);
-    exti_set_trigger(EXTI2 | EXTI3, EXTI_TRIGGER_RISING);
-    exti_enable_request(EXTI2 | EXTI3);
+void tim2_isr(void) {
+    // A capture overwritten before it was read is an edge lost to interrupt latency
+    if (timer_get_flag(TIM2, TIM_SR_CC3OF | TIM_SR_CC4OF)) {
+        timer_clear_flag(TIM2, TIM_SR_CC3OF | TIM_SR_CC4OF);
+        diagnostics.missed_edges++;
+    }
+
+    if (timer_get_flag(TIM2, TIM_SR_CC3IF)) {
+        timer_clear_flag(TIM2, TIM_SR_CC3IF);
+        voltage_edge_add((uint16_t)TIM_CCR3(TIM2));
+    }
+
+    if (timer_get_flag(TIM2, TIM_SR_CC4IF)) {
+        timer_clear_flag(TIM2, TIM_SR_CC4IF);
+        current_edge_add((uint16_t)TIM_CCR4(TIM2));
+    }
 }
+#else
+/**
+ * @brief DMA1 channel 7 interrupt: counts the passes of the DMA over the capture stream.
+ */
+void dma1_channel7_isr(void) {
+    if (dma_get_interrupt_flag(DMA1, PHASE_DMA_CHANNEL, DMA_TCIF)) {
+        dma_clear_interrupt_flags(DMA1, PHASE_DMA_CHANNEL, DMA_TCIF);
+        stream_laps++;
+    }
+}
+#endif
 
 /**
- * @brief EXTI2 interrupt service routine (ISR).
- * 
- * Resets the EXTI2 interrupt request, resets Timer 2 counter to 0, and starts Timer 2.
+ * @brief Consumes the capture pairs written by DMA since the last call.
+ *
+ * The write position is derived from the DMA remaining-count register and rounded
+ * down to a whole pair, so a burst in progress is left for the next call. In
+ * interrupt mode the edges are handled by `tim2_isr()` and this does nothing.
+ *
+ * The DMA passes counted by its interrupt tell how far the writer is ahead. If it is
+ * more than the whole stream ahead, it lapped the reader and overwrote pairs not read
+ * yet: everything unread is dropped and counted as missed edges, the reader jumps to
+ * the write position and both edge references are dropped, since the Timer 2 captures
+ * no longer follow on from them.
+ *
+ * Only a current edge (CC4) requests the burst: TIM2_CH3 would need DMA1 channel 1,
+ * which the ADC owns. A voltage edge is thus only read with the next current edge:
+ * - a second voltage capture before that sets the CC3 overcapture flag, counted here
+ *   as a missed edge;
+ * - with no current edges (no load) no voltage edge is read at all: after
+ *   `PHASE_VOLTAGE_TIMEOUT_MS` the period is dropped and `get_line_frequency()`
+ *   reports 0 instead of the last value, until edges come back.
  */
-void exti2_isr(void) {
-    exti_reset_request(EXTI2);
-    timer_set_counter(TIM2, 0);
-    timer_enable_counter(TIM2);
+void phase_capture_poll(void) {
+#if PHASE_CAPTURE_DMA
+    uint32_t primask = cm_mask_interrupts(1);
+    uint16_t remaining = dma_get_number_of_data(DMA1, PHASE_DMA_CHANNEL);
+    uint32_t laps = stream_laps;
+    if (dma_get_interrupt_flag(DMA1, PHASE_DMA_CHANNEL, DMA_TCIF)) {
+        // Wrapped but not counted yet: read the position again, now surely after the wrap
+        laps++;
+        remaining = dma_get_number_of_data(DMA1, PHASE_DMA_CHANNEL);
+    }
+    cm_mask_interrupts(primask);
+
+    uint16_t write_index = PHASE_STREAM_WORDS - remaining;
+    write_index &= (uint16_t)~1U;
+    if (write_index >= PHASE_STREAM_WORDS) {
+        write_index = 0;
+    }
+
+    uint32_t unread = (laps - stream_read_laps) * PHASE_STREAM_WORDS + write_index - stream_read_index;
+    if (unread > PHASE_STREAM_WORDS) {
+        diagnostics.missed_edges += unread;  // One voltage and one current edge per pair
+        stream_read_index = write_index;
+        stream_read_laps = laps;
+        voltage_edge_valid = 0;
+        voltage_edge_fresh = 0;
+        current_edge_valid = 0;
+        return;
+    }
+
+    for (; unread > 0; unread -= PHASE_DMA_BURST_LENGTH) {
+        voltage_edge_add(capture_stream[stream_read_index]);
+        current_edge_add(capture_stream[stream_read_index + 1]);
+        stream_read_index += PHASE_DMA_BURST_LENGTH;
+        if (stream_read_index >= PHASE_STREAM_WORDS) {
+            stream_read_index = 0;
+            stream_read_laps++;
+        }
+    }
+
+    // A voltage edge captured over one not yet read by a burst
+    if (timer_get_flag(TIM2, TIM_SR_CC3OF)) {
+        timer_clear_flag(TIM2, TIM_SR_CC3OF);
+        diagnostics.missed_edges++;
+    }
+
+    uint32_t now = sys_milis;
+    if (voltage_edge_count != voltage_edges_checked) {
+        voltage_edges_checked = voltage_edge_count;
+        voltage_edge_seen_ms = now;
+    } else if ((now - voltage_edge_seen_ms) > PHASE_VOLTAGE_TIMEOUT_MS) {
+        period_valid = 0;
+        period_locked = 0;
+        voltage_edge_valid = 0;
+        voltage_edge_fresh = 0;
+    }
+#endif
 }
 
 /**
- * @brief EXTI3 interrupt service routine (ISR).
- * 
- * - Resets the EXTI3 interrupt request.
- * - Stores the Timer 2 counter value in the phase shift buffer.
- * - Calculates the average phase shift when the buffer is full.
+ * @brief Returns the mains frequency measured between voltage edges.
+ *
+ * @return Frequency in Hz.
  */
-void exti3_isr(void) {
-    exti_reset_request(EXTI3);
-    if (counter < N_PHASE_SHIFT) {
-        phase_shift_buffer[counter] = timer_get_counter(TIM2);
-        counter++;
-    } else if (counter == N_PHASE_SHIFT) {
-        phase_shift = average_phase_shift();
-        counter = 0;
+float get_line_frequency(void) {
+#if PHASE_SOURCE == PHASE_SOURCE_SAMPLES
+    return zc_get_frequency();
+#else
+    uint16_t period = cycle_period;
+
+    if (!period_valid || period == 0) {
+#if PHASE_SOURCE == PHASE_SOURCE_CROSSCHECK
+        return zc_get_frequency();  // The sample detector still sees the voltage
+#else
+        return 0;
+#endif
     }
-    timer_disable_counter(TIM2);
+    return (float)TM2_TICK_HZ / (float)period;
+#endif
+}
+
+/**
+ * @brief Returns the edge and sample rejection counters.
+ *
+ * @return Counters accumulated since start-up.
+ */
+phase_diagnostics_t get_phase_diagnostics(void) {
+    phase_diagnostics_t copy;
+
+    copy.rejected_edges = diagnostics.rejected_edges;
+    copy.missed_edges = diagnostics.missed_edges;
+    copy.rejected_samples = diagnostics.rejected_samples;
+    return copy;
 }
 
 /**
- * @brief Calculates the average phase shift from the buffer.
+ * @brief Reads a consistent snapshot of the phase shift state.
+ *
+ * Lock-free: interrupts stay enabled and the copy is retried if the capture path
+ * published a new sample in the middle of it.
+ *
+ * @return Running sum, sample count, last and filtered sample and total samples.
+ */
+phase_snapshot_t get_phase_snapshot(void) {
+    phase_snapshot_t snapshot;
+    uint32_t sequence;
+
+    do {
+        sequence = phase_sequence;
+        __dmb();
+        snapshot.sum = phase_published.sum;
+        snapshot.count = phase_published.count;
+        snapshot.last = phase_published.last;
+        snapshot.filtered = phase_published.filtered;
+        snapshot.samples = phase_published.samples;
+        __dmb();
+    } while ((sequence & 1U) || sequence != phase_sequence);
+
+    return snapshot;
+}
+
+/**
+ * @brief Returns the filtered phase angle.
  * 
- * @return The average phase shift as a floating-point value.
+ * @return The filtered signed phase angle in degrees (positive: current lagging).
  */
 float average_phase_shift(void) {
-    for (int i = 0; i < N_PHASE_SHIFT; i++) {
-        phase_shift += phase_shift_buffer[i];
+#if PHASE_SOURCE == PHASE_SOURCE_SAMPLES
+    return zc_get_phase_angle();
+#else
+    phase_snapshot_t snapshot = get_phase_snapshot();
+
+    if (snapshot.count == 0) {
+        return 0;
     }
-    return (phase_shift / N_PHASE_SHIFT);
+    return (float)snapshot.filtered * (360.0f / PHASE_Q15_TURN);
+#endif
+}
+
+/**
+ * @brief Calculates the power factor from the average phase angle.
+ * 
+ * @return Displacement power factor, from -1 to 1: negative beyond +/-90 deg, when
+ *         power flows back or the CT is reversed. The sign of `average_phase_shift()`
+ *         tells whether it is lagging or leading.
+ */
+float get_power_factor(void) {
+    return cosf(average_phase_shift() * ((float)M_PI / 180.0f));
 }
@@ -0,0 +1,538 @@
+/**
+ * @file ui.c
+ * @brief Display pages, field refresh scheduling and page button.
+ */
+
+#include "ui.h"
+#include "refresh.h"
+#include "fmt.h"
+#include <string.h>
+#include <math.h>
+
+/**
+ * @brief Rounds a signed value to the nearest integer.
+ */
+static int32_t ui_round(float value) {
+    return (int32_t)(value < 0 ? value - 0.5f : value + 0.5f);
+}
+
+/** @brief Metering values shown, each following the meter outside its deadband. */
+static metering_snapshot_t ui_values = {0, 0, 0, 0, 0, 0, 0};
+
+/** @brief Short names of the tariff bands. */
+static const char *const ui_band_names[TARIFF_MAX_BANDS] = {"Rest", "Vall", "Peak", "Bnd3"};
+
+/** @brief Power history, oldest first. */
+static float ui_history[UI_HISTORY_LENGTH];
+
+/** @brief Samples in `ui_history`. */
+static uint8_t ui_history_count = 0;
+
+/** @brief Meter second of the last history sample. */
+static uint32_t ui_history_second = 0;
+
+/*
+ * Render functions. Each one formats into `width` characters with the bounded `fmt`
+ * writer, so long values are truncated instead of overrunning; `ui_poll()` pads the
+ * rest of the field with spaces.
+ */
+
+static void render_voltage(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "U ");
+    fmt_float(&f, ui_values.voltage, 0, 3);
+    fmt_str(&f, " V");
+}
+
+static void render_current(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "I ");
+    fmt_float(&f, ui_values.current, 2, 0);
+    fmt_char(&f, 'A');
+}
+
+static void render_frequency(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_float(&f, ui_values.frequency, 2, 0);
+    fmt_str(&f, "Hz");
+}
+
+static void render_power_factor(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "PF ");
+    fmt_float(&f, ui_values.power_factor, 2, 0);
+}
+
+static void render_power(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_char(&f, 'P');
+    fmt_power(&f, ui_values.power, 6);
+}
+
+static void render_phase(char *out, uint8_t width) {
+    int32_t phase = ui_round(ui_values.phase);
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, (phase < 0) ? "lead" : (phase > 0) ? "lag " : "    ");  // In phase: no tag
+    fmt_int(&f, phase, 4);
+}
+
+static void render_power_bar(char *out, uint8_t width) {
+    glyph_bar(out, width, ui_values.power, UI_POWER_FULL_SCALE_W);
+}
+
+static void render_energy(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "E ");
+    fmt_float(&f, tariff_get_total_kwh(), 3, 0);
+    fmt_str(&f, " kWh");
+}
+
+static void render_cost(char *out, uint8_t width) {
+    uint8_t band = tariff_get_active_band();
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "$ ");
+    fmt_float(&f, tariff_get_cost(), 2, 0);
+    fmt_char(&f, ' ');
+    fmt_str(&f, (band < TARIFF_MAX_BANDS) ? ui_band_names[band] : "");
+}
+
+static void render_demand(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_char(&f, 'D');
+    fmt_power(&f, (float)demand_get_rolling_w(), 6);
+    fmt_str(&f, " pk");
+    fmt_power(&f, (float)demand_get_rolling_peak().demand_w, 6);
+}
+
+static void render_history_label(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_uint(&f, UI_HISTORY_LENGTH * UI_HISTORY_STEP_S / 60, 0);
+    fmt_char(&f, 'm');
+}
+
+static void render_history(char *out, uint8_t width) {
+    uint8_t count = (ui_history_count < width) ? ui_history_count : width;
+
+    // Right-aligned, the newest sample in the last cell; auto-ranged
+    memset(out, ' ', width - count);
+    glyph_sparkline(out + (width - count), ui_history + (ui_history_count - count), count, 0, 0);
+}
+
+static void render_line_frequency(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "f ");
+    fmt_float(&f, ui_values.frequency, 2, 0);
+    fmt_str(&f, " Hz");
+}
+
+static void render_crest_factors(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "CF U");
+    fmt_float(&f, get_waveform_metrics(0).crest_factor, 2, 0);
+    fmt_str(&f, " I");
+    fmt_float(&f, get_waveform_metrics(1).crest_factor, 2, 0);
+}
+
+static void render_phase_angle(char *out, uint8_t width) {
+    int32_t phase = ui_round(ui_values.phase);
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "Ph ");
+    fmt_int(&f, phase, 4);
+    fmt_str(&f, (phase < 0) ? " deg lead" : (phase > 0) ? " deg lag" : " deg");
+}
+
+static void render_peak_hold(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "Pk ");
+    fmt_float(&f, get_waveform_metrics(0).peak_hold, 0, 3);
+    fmt_str(&f, "V ");
+    fmt_float(&f, get_waveform_metrics(1).peak_hold, 1, 0);
+    fmt_char(&f, 'A');
+}
+
+static void render_power_mean(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "Pavg ");
+    fmt_power(&f, stats_get_result(STATS_POWER).mean, 7);
+}
+
+static void render_power_range(char *out, uint8_t width) {
+    stats_result_t power = stats_get_result(STATS_POWER);
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "P ");
+    fmt_power(&f, power.min, 0);
+    fmt_char(&f, '-');
+    fmt_power(&f, power.max, 0);
+}
+
+static void render_power_percentiles(char *out, uint8_t width) {
+    stats_result_t power = stats_get_result(STATS_POWER);
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "P95");
+    fmt_float(&f, power.p95, 0, 5);
+    fmt_str(&f, " 99");
+    fmt_float(&f, power.p99, 0, 5);
+}
+
+static void render_voltage_range(char *out, uint8_t width) {
+    stats_result_t voltage = stats_get_result(STATS_VOLTAGE);
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "U ");
+    fmt_float(&f, voltage.min, 0, 0);
+    fmt_char(&f, '-');
+    fmt_float(&f, voltage.max, 0, 0);
+    fmt_str(&f, " V");
+}
+
+static void render_edge_errors(char *out, uint8_t width) {
+    phase_diagnostics_t edges = get_phase_diagnostics();
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "Edg r");
+    fmt_uint(&f, edges.rejected_edges, 0);
+    fmt_str(&f, " m");
+    fmt_uint(&f, edges.missed_edges, 0);
+    fmt_str(&f, " s");
+    fmt_uint(&f, edges.rejected_samples, 0);
+}
+
+static void render_bus_errors(char *out, uint8_t width) {
+    i2c_bus_stats_t bus = i2c_bus_get_stats();
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "I2C n");
+    fmt_uint(&f, bus.nacks, 0);
+    fmt_str(&f, " e");
+    fmt_uint(&f, bus.bus_errors, 0);
+    fmt_str(&f, " t");
+    fmt_uint(&f, bus.timeouts, 0);
+}
+
+static void render_display_errors(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_str(&f, "Dsp r");
+    fmt_uint(&f, display_get_resyncs(), 0);
+    fmt_str(&f, " g");
+    fmt_uint(&f, glyph_get_uploads(), 0);
+}
+
+static void render_crosscheck(char *out, uint8_t width) {
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+#if PHASE_SOURCE == PHASE_SOURCE_CROSSCHECK
+    zc_diagnostics_t check = zc_get_diagnostics();
+    fmt_str(&f, check.mismatch ? "Xbad" : "Xok");
+    fmt_int(&f, ui_round(check.difference_deg), 5);
+#else
+    fmt_str(&f, "NILM ");
+    fmt_uint(&f, nilm_get_event_count(), 0);
+#endif
+}
+
+static void render_cpu_load(char *out, uint8_t width) {
+    uint16_t load = sched_get_load().load_permille;
+    fmt_t f;
+    fmt_init(&f, out, width + 1);
+    fmt_char(&f, 'C');  // 100 % would not fit: shown as 99.9
+    fmt_fixed(&f, (load > 999) ? 999 : load, 1, 4);
+    fmt_char(&f, '%');
+}
+
+/** @brief Instantaneous values. */
+static const ui_field_t ui_instant_fields[] = {
+    {0, 0, 8, 0, 250, render_voltage},
+    {0, 9, 7, 0, 1000, render_frequency},
+    {1, 0, 8, 0, 250, render_current},
+    {1, 9, 7, 0, 500, render_power_factor},
+    {2, 0, 8, 0, 250, render_power},
+    {2, 8, 8, 0, 500, render_phase},
+    {3, 0, 16, UI_FIELD_GLYPHS, 250, render_power_bar},
+};
+
+/** @brief Energy registers. */
+static const ui_field_t ui_energy_fields[] = {
+    {0, 0, 16, 0, 1000, render_energy},
+    {1, 0, 16, 0, 1000, render_cost},
+    {2, 0, 16, 0, 1000, render_demand},
+    {3, 0, 3, 0, 0, render_history_label},
+    {3, 4, UI_HISTORY_LENGTH, UI_FIELD_GLYPHS, 1000, render_history},
+};
+
+/** @brief Power quality. */
+static const ui_field_t ui_quality_fields[] = {
+    {0, 0, 16, 0, 1000, render_line_frequency},
+    {1, 0, 16, 0, 1000, render_crest_factors},
+    {2, 0, 16, 0, 500, render_phase_angle},
+    {3, 0, 16, 0, 1000, render_peak_hold},
+};
+
+/** @brief Statistics of the last completed period. */
+static const ui_field_t ui_stats_fields[] = {
+    {0, 0, 16, 0, 2000, render_power_mean},
+    {1, 0, 16, 0, 2000, render_power_range},
+    {2, 0, 16, 0, 2000, render_power_percentiles},
+    {3, 0, 16, 0, 2000, render_voltage_range},
+};
+
+/** @brief Error counters. */
+static const ui_field_t ui_diag_fields[] = {
+    {0, 0, 16, 0, 2000, render_edge_errors},
+    {1, 0, 16, 0, 2000, render_bus_errors},
+    {2, 0, 16, 0, 2000, render_display_errors},
+    {3, 0, 9, 0, 2000, render_crosscheck},
+    {3, 10, 6, 0, 1000, render_cpu_load},
+};
+
+/** @brief Page table, indexed by `ui_page_id_t`. */
+static const ui_page_t ui_pages[UI_PAGE_COUNT] = {
+    {ui_instant_fields, sizeof(ui_instant_fields) / sizeof(ui_instant_fields[0])},
+    {ui_energy_fields, sizeof(ui_energy_fields) / sizeof(ui_energy_fields[0])},
+    {ui_quality_fields, sizeof(ui_quality_fields) / sizeof(ui_quality_fields[0])},
+    {ui_stats_fields, sizeof(ui_stats_fields) / sizeof(ui_stats_fields[0])},
+    {ui_diag_fields, sizeof(ui_diag_fields) / sizeof(ui_diag_fields[0])},
+};
+
+/** @brief Page shown. */
+static ui_page_id_t ui_page = UI_PAGE_INSTANT;
+
+/** @brief Set by a page change: the next poll redraws every field. */
+static uint8_t ui_redraw = 1;
+
+/** @brief Text last written by each field of the page. */
+static char ui_field_text[UI_MAX_FIELDS][DISPLAY_MAX_COLS + 1];
+
+/** @brief SysTick time of the last render of each field of the page. */
+static uint32_t ui_field_time[UI_MAX_FIELDS];
+
+/** @brief Field writes to the framebuffer. */
+static uint32_t ui_field_writes = 0;
+
+/** @brief SysTick time of the last refresh pass. */
+static uint32_t ui_refresh_time = 0;
+
+/** @brief Refresh passes. */
+static uint32_t ui_refreshes = 0;
+
+/** @brief Debounced button level (1: released). */
+static uint8_t button_stable = 1;
+
+/** @brief Button level at the previous poll. */
+static uint8_t button_last = 1;
+
+/** @brief SysTick time of the last change of the raw button level. */
+static uint32_t button_since = 0;
+
+void ui_init(void) {
+    gpio_set_mode(UI_BUTTON_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_PULL_UPDOWN, UI_BUTTON_PIN);
+    gpio_set(UI_BUTTON_PORT, UI_BUTTON_PIN);  // Pull-up
+
+    // Both edges wake the display task; the level is still debounced by polling
+    exti_select_source(UI_BUTTON_EXTI, UI_BUTTON_PORT);
+    exti_set_trigger(UI_BUTTON_EXTI, EXTI_TRIGGER_BOTH);
+    exti_enable_request(UI_BUTTON_EXTI);
+    nvic_enable_irq(NVIC_EXTI15_10_IRQ);
+
+    glyph_init();
+    ui_history_count = 0;
+    ui_history_second = metering_get_seconds();
+    ui_set_page(UI_PAGE_INSTANT);
+}
+
+void ui_set_page(ui_page_id_t page) {
+    if (page < UI_PAGE_COUNT) {
+        ui_page = page;
+        ui_redraw = 1;
+    }
+}
+
+void ui_next_page(void) {
+    ui_set_page((ui_page_id_t)((ui_page + 1) % UI_PAGE_COUNT));
+}
+
+ui_page_id_t ui_get_page(void) {
+    return ui_page;
+}
+
+/**
+ * @brief EXTI lines 10 to 15 interrupt: the page button changed level.
+ */
+void exti15_10_isr(void) {
+    exti_reset_request(UI_BUTTON_EXTI);
+    sched_post(SCHED_EVENT_BUTTON);
+}
+
+uint32_t ui_get_refreshes(void) {
+    return ui_refreshes;
+}
+
+uint32_t ui_get_field_writes(void) {
+    return ui_field_writes;
+}
+
+/**
+ * @brief Debounces the page button; a press advances the page.
+ *
+ * @param now SysTick time.
+ */
+static void ui_button_poll(uint32_t now) {
+    uint8_t level = gpio_get(UI_BUTTON_PORT, UI_BUTTON_PIN) ? 1 : 0;
+
+    if (level != button_last) {
+        button_last = level;
+        button_since = now;
+    } else if (level != button_stable && (now - button_since) >= UI_DEBOUNCE_MS) {
+        button_stable = level;
+        if (!level) {
+            ui_next_page();
+        }
+    }
+}
+
+/**
+ * @brief Appends a power sample to the history every `UI_HISTORY_STEP_S` meter seconds.
+ */
+static void ui_history_poll(void) {
+    uint32_t seconds = metering_get_seconds();
+
+    if ((seconds - ui_history_second) < UI_HISTORY_STEP_S) {
+        return;
+    }
+    ui_history_second = seconds;
+
+    if (ui_history_count == UI_HISTORY_LENGTH) {
+        memmove(ui_history, ui_history + 1, (UI_HISTORY_LENGTH - 1) * sizeof(ui_history[0]));
+        ui_history_count--;
+    }
+    ui_history[ui_history_count++] = metering_get_snapshot().power;
+}
+
+/**
+ * @brief Moves a shown value to the measured one if it left the deadband.
+ *
+ * @param shown Value on display.
+ * @param measured Latest measurement.
+ * @param deadband Smallest change shown.
+ * @param force Non-zero to take the measurement regardless.
+ */
+static void ui_follow(float *shown, float measured, float deadband, uint8_t force) {
+    if (force || fabsf(measured - *shown) >= deadband) {
+        *shown = measured;
+    }
+}
+
+/**
+ * @brief Takes the latest metering snapshot through the deadbands.
+ *
+ * @param force Non-zero to take every value (page redraw).
+ */
+static void ui_values_update(uint8_t force) {
+    metering_snapshot_t latest = metering_get_snapshot();
+
+    ui_follow(&ui_values.voltage, latest.voltage, UI_DEADBAND_VOLTAGE, force);
+    ui_follow(&ui_values.current, latest.current, UI_DEADBAND_CURRENT, force);
+    ui_follow(&ui_values.power, latest.power, UI_DEADBAND_POWER, force);
+    ui_follow(&ui_values.frequency, latest.frequency, UI_DEADBAND_FREQUENCY, force);
+    if (force || fabsf(latest.phase - ui_values.phase) >= UI_DEADBAND_PHASE) {
+        ui_values.phase = latest.phase;
+        ui_values.power_factor = latest.power_factor;
+    }
+    ui_values.block = latest.block;
+}
+
+/**
+ * @brief Renders the due fields and queues what changed.
+ *
+ * Nothing is rendered between refresh passes, except right after a page change. A
+ * field is due when its period elapsed, or on a redraw. If any glyph field is due,
+ * all of them are, inside one glyph frame.
+ */
+void ui_poll(void) {
+    const ui_page_t *page;
+    uint32_t now = sys_milis;
+    uint8_t redraw;
+    uint8_t glyphs_due;
+    char text[DISPLAY_MAX_COLS + 1];
+
+    ui_button_poll(now);
+    ui_history_poll();
+
+    redraw = ui_redraw;
+    if (!redraw && (now - ui_refresh_time) < UI_REFRESH_MS) {
+        if (display_has_backlog()) {
+            // The backend ran out of room: push the rest as it drains
+            glyph_flush();
+            display_flush();
+        }
+        return;
+    }
+    ui_refresh_time = now;
+    ui_refreshes++;
+    page = &ui_pages[ui_page];
+    glyphs_due = redraw;
+
+    ui_values_update(redraw);
+    if (redraw) {
+        ui_redraw = 0;
+        display_clear();
+    }
+
+    for (uint8_t i = 0; i < page->count && !glyphs_due; i++) {
+        const ui_field_t *field = &page->fields[i];
+        if ((field->flags & UI_FIELD_GLYPHS) && (now - ui_field_time[i]) >= field->period_ms) {
+            glyphs_due = 1;
+        }
+    }
+    if (glyphs_due) {
+        glyph_begin_frame();
+    }
+
+    for (uint8_t i = 0; i < page->count; i++) {
+        const ui_field_t *field = &page->fields[i];
+        uint8_t due;
+
+        if (field->flags & UI_FIELD_GLYPHS) {
+            due = glyphs_due;
+        } else {
+            due = redraw || (field->period_ms != 0 && (now - ui_field_time[i]) >= field->period_ms);
+        }
+        if (!due) {
+            continue;
+        }
+        ui_field_time[i] = now;
+
+        text[0] = '\0';
+        field->render(text, field->width);
+        for (uint8_t col = (uint8_t)strlen(text); col < field->width; col++) {
+            text[col] = ' ';
+        }
+        text[field->width] = '\0';
+
+        if (redraw || strcmp(text, ui_field_text[i]) != 0) {
+            memcpy(ui_field_text[i], text, field->width + 1);
+            display_write(field->row, field->col, text);
+            ui_field_writes++;
+        }
+    }
+
+    glyph_flush();
+    display_flush();
+}
@@ -0,0 +1,364 @@
+/**
+ * @file zero_cross.c
+ * @brief Sample-domain zero-crossing detector and optocoupler cross-check.
+ *
+ * Crossing times are kept in 1/256 of a sample on a 32-bit clock that wraps every
+ * 56 minutes at 5 kHz; only modulo-2^32 differences of them are used.
+ */
+
+#include "zero_cross.h"
+#include "adc_dma.h"
+#include <math.h>
+
+/** @brief Shortest accepted mains period in 1/256 samples (65 Hz). */
+#define ZC_PERIOD_MIN (((uint32_t)ADC_SAMPLE_RATE_HZ << ZC_FRACTION_BITS) / 65)
+
+/** @brief Longest accepted mains period in 1/256 samples (45 Hz). */
+#define ZC_PERIOD_MAX (((uint32_t)ADC_SAMPLE_RATE_HZ << ZC_FRACTION_BITS) / 45)
+
+/**
+ * @brief Detector state of one ADC channel.
+ */
+typedef struct {
+    int32_t bias;          /**< Tracked DC bias in ADC counts. */
+    int32_t bias_average;  /**< Bias scaled by 2^`ZC_BIAS_SHIFT`, keeping the fraction of the average. */
+    int32_t previous;      /**< Last sample seen, carried over between blocks. */
+    uint32_t sum;          /**< Sum of the samples of the block in progress. */
+    uint8_t armed;         /**< Non-zero once the signal went below the bias minus the hysteresis. */
+} zc_channel_t;
+
+/** @brief Voltage and current channel state, owned by the ADC interrupt. */
+static zc_channel_t channels[ADC_CHANNEL_COUNT];
+
+/** @brief Index of the first sample of the next block. */
+static uint32_t sample_clock = 0;
+
+/** @brief Time of the last accepted voltage crossing, in 1/256 samples. */
+static uint32_t voltage_crossing = 0;
+
+/** @brief Non-zero once `voltage_crossing` holds a crossing. */
+static uint8_t voltage_valid = 0;
+
+/** @brief Non-zero while the last voltage crossing has not been paired with a current crossing. */
+static uint8_t voltage_fresh = 0;
+
+/** @brief Last measured mains period in 1/256 samples (0 until measured). */
+static uint32_t period = 0;
+
+/** @brief Smoothed angle as a 32-bit fraction of a turn; the top 16 bits are the Q15 angle. */
+static uint32_t angle_average = 0;
+
+/** @brief Results being built by the ADC interrupt. */
+static zc_snapshot_t working = {0, 0, 0, 0};
+
+/** @brief Seqlock sequence: odd while `published` is being written. */
+static volatile uint32_t sequence = 0;
+
+/** @brief Results published to the readers. */
+static volatile zc_snapshot_t published = {0, 0, 0, 0};
+
+/** @brief Cross-check diagnostic, owned by the main loop. */
+static zc_diagnostics_t diagnostics = {0, 0, 0};
+
+/** @brief Consecutive failed cross-checks. */
+static uint8_t failed_checks = 0;
+
+/** @brief Sample-domain phase samples at the previous cross-check. */
+static uint32_t checked_crossings = 0;
+
+/** @brief Optocoupler phase samples at the previous cross-check. */
+static uint32_t checked_opto_samples = 0;
+
+/**
+ * @brief Registers a rising voltage crossing and measures the period.
+ *
+ * A crossing closer than a 65 Hz period to the previous one is a glitch and is dropped
+ * without moving the reference; a longer interval than a 45 Hz period means crossings
+ * were missed, so only the reference is moved.
+ *
+ * @param time Crossing time in 1/256 samples.
+ */
+static void voltage_crossing_add(uint32_t time) {
+    if (voltage_valid) {
+        uint32_t interval = time - voltage_crossing;
+
+        if (interval < ZC_PERIOD_MIN) {
+            return;
+        }
+        if (interval <= ZC_PERIOD_MAX) {
+            period = interval;
+            working.period = interval;
+        }
+    }
+    voltage_crossing = time;
+    voltage_valid = 1;
+    voltage_fresh = 1;
+    working.v_crossings++;
+}
+
+/**
+ * @brief Turns a rising current crossing into a phase angle sample.
+ *
+ * Same convention as the optocoupler path: the delay from the last voltage crossing is
+ * normalised to the period in Q15 turns and wrapped to 16 bits, pairing the current
+ * with the nearest voltage crossing. A current crossing slightly ahead of the voltage
+ * one (negative delay) is measured against the previous voltage crossing and wraps to a
+ * small negative angle.
+ *
+ * The average is kept as a 32-bit fraction of a turn and updated with the wrapped
+ * 16-bit difference, so it stays correct across the +/-180 deg boundary.
+ *
+ * @param time Crossing time in 1/256 samples, corrected for the conversion skew.
+ */
+static void current_crossing_add(uint32_t time) {
+    int32_t delay = (int32_t)(time - voltage_crossing);
+
+    if (!voltage_valid || period == 0) {
+        return;
+    }
+    if (delay < 0) {
+        delay += (int32_t)period;  // Crossed just before the voltage: pair with the previous cycle
+    } else if (voltage_fresh) {
+        voltage_fresh = 0;
+    } else {
+        return;
+    }
+    if (delay < 0 || (uint32_t)delay >= period) {
+        return;
+    }
+
+    int16_t sample = (int16_t)(uint16_t)(((uint32_t)delay << 16) / period);
+
+    if (working.i_crossings == 0) {
+        angle_average = (uint32_t)(uint16_t)sample << 16;
+    } else {
+        int16_t difference = (int16_t)(uint16_t)(sample - (int16_t)(angle_average >> 16));
+        angle_average += (uint32_t)((int32_t)difference * (1 << (16 - ZC_ANGLE_SHIFT)));
+    }
+    working.angle_q15 = (int16_t)(angle_average >> 16);
+    working.i_crossings++;
+}
+
+/**
+ * @brief Publishes the working results to the readers (single writer, never waits).
+ */
+static void zc_publish(void) {
+    sequence++;
+    __dmb();
+    published.angle_q15 = working.angle_q15;
+    published.period = working.period;
+    published.v_crossings = working.v_crossings;
+    published.i_crossings = working.i_crossings;
+    __dmb();
+    sequence++;
+}
+
+/**
+ * @brief Moves each bias towards the mean of the block just summed, and clears the sums.
+ *
+ * @param pairs Number of sample pairs summed.
+ */
+static void bias_update(uint16_t pairs) {
+    for (uint8_t ch = 0; ch < ADC_CHANNEL_COUNT; ch++) {
+        zc_channel_t *c = &channels[ch];
+        int32_t mean = (int32_t)(c->sum / pairs);
+
+        c->bias_average += mean - c->bias;
+        c->bias = c->bias_average >> ZC_BIAS_SHIFT;
+        c->sum = 0;
+    }
+}
+
+/**
+ * @brief Resets the detector state.
+ */
+void zc_init(void) {
+    for (uint8_t ch = 0; ch < ADC_CHANNEL_COUNT; ch++) {
+        channels[ch].bias = ZC_INITIAL_BIAS;
+        channels[ch].bias_average = ZC_INITIAL_BIAS << ZC_BIAS_SHIFT;
+        channels[ch].previous = ZC_INITIAL_BIAS;
+        channels[ch].sum = 0;
+        channels[ch].armed = 0;
+    }
+    sample_clock = 0;
+    voltage_valid = 0;
+    voltage_fresh = 0;
+    period = 0;
+    angle_average = 0;
+    working.angle_q15 = 0;
+    working.period = 0;
+    working.v_crossings = 0;
+    working.i_crossings = 0;
+    zc_publish();
+}
+
+/**
+ * @brief Runs the detector on one block of interleaved (voltage, current) samples.
+ *
+ * Both channels are scanned sample by sample so the crossings are handled in time
+ * order. A crossing is interpolated between the last sample under the bias and the
+ * first one at or above it. After the block each bias moves towards the block mean,
+ * which over whole mains cycles is the DC level of the sensor.
+ *
+ * @param block First sample of the block.
+ * @param pairs Number of (voltage, current) sample pairs in the block.
+ */
+void zc_process_block(const volatile uint16_t *block, uint16_t pairs) {
+    for (uint16_t k = 0; k < pairs; k++) {
+        for (uint8_t ch = 0; ch < ADC_CHANNEL_COUNT; ch++) {
+            zc_channel_t *c = &channels[ch];
+            int32_t sample = block[k * ADC_CHANNEL_COUNT + ch];
+
+            c->sum += (uint32_t)sample;
+            if (!c->armed) {
+                if (sample < c->bias - ZC_HYSTERESIS) {
+                    c->armed = 1;
+                }
+            } else if (sample >= c->bias) {
+                uint32_t fraction = 0;
+                if (c->previous < c->bias) {
+                    fraction = ((uint32_t)(c->bias - c->previous) << ZC_FRACTION_BITS) / (uint32_t)(sample - c->previous);
+                }
+                uint32_t time = ((sample_clock + k - 1) << ZC_FRACTION_BITS) + fraction;
+
+                c->armed = 0;
+                if (ch == 0) {
+                    voltage_crossing_add(time);
+                } else {
+                    current_crossing_add(time + ZC_CURRENT_SKEW);
+                }
+            }
+            c->previous = sample;
+        }
+    }
+
+    bias_update(pairs);
+    sample_clock += pairs;
+
+    zc_publish();
+}
+
+/**
+ * @brief Tracks the DC bias of one block without looking for crossings.
+ *
+ * @param block First sample of the block.
+ * @param pairs Number of (voltage, current) sample pairs in the block.
+ */
+void zc_track_bias(const volatile uint16_t *block, uint16_t pairs) {
+    for (uint16_t k = 0; k < pairs; k++) {
+        for (uint8_t ch = 0; ch < ADC_CHANNEL_COUNT; ch++) {
+            channels[ch].sum += block[k * ADC_CHANNEL_COUNT + ch];
+        }
+    }
+    bias_update(pairs);
+}
+
+/**
+ * @brief Returns the tracked DC bias of a channel.
+ *
+ * A single word is read, so no lock is needed against the ADC interrupt.
+ *
+ * @param channel `0` for voltage, `1` for current.
+ * @return Bias in ADC counts, or the initial bias for an invalid channel.
+ */
+float zc_get_bias(uint8_t channel) {
+    if (channel >= ADC_CHANNEL_COUNT) {
+        return ZC_INITIAL_BIAS;
+    }
+    return (float)channels[channel].bias_average * (1.0f / (1 << ZC_BIAS_SHIFT));
+}
+
+/**
+ * @brief Reads a consistent snapshot of the detector results.
+ *
+ * @return Published results.
+ */
+zc_snapshot_t zc_get_snapshot(void) {
+    zc_snapshot_t snapshot;
+    uint32_t start;
+
+    do {
+        start = sequence;
+        __dmb();
+        snapshot.angle_q15 = published.angle_q15;
+        snapshot.period = published.period;
+        snapshot.v_crossings = published.v_crossings;
+        snapshot.i_crossings = published.i_crossings;
+        __dmb();
+    } while ((start & 1U) || start != sequence);
+
+    return snapshot;
+}
+
+/**
+ * @brief Returns the phase angle measured from the samples.
+ *
+ * @return Signed angle in degrees (positive: current lagging).
+ */
+float zc_get_phase_angle(void) {
+    return (float)zc_get_snapshot().angle_q15 * (360.0f / 65536.0f);
+}
+
+/**
+ * @brief Returns the mains frequency measured from the samples.
+ *
+ * @return Frequency in Hz, or 0 before a period was measured.
+ */
+float zc_get_frequency(void) {
+    uint32_t measured = zc_get_snapshot().period;
+
+    if (measured == 0) {
+        return 0;
+    }
+    return (float)((uint32_t)ADC_SAMPLE_RATE_HZ << ZC_FRACTION_BITS) / (float)measured;
+}
+
+/**
+ * @brief Compares the optocoupler phase with the sample-domain phase.
+ *
+ * Nothing is checked while the sample detector itself has no new phase sample (no
+ * current flowing, or no mains), since there is then no reference to compare with.
+ *
+ * @param opto_deg Phase angle measured by the optocouplers, in degrees.
+ * @param opto_samples Total optocoupler phase samples taken so far.
+ */
+void zc_crosscheck(float opto_deg, uint32_t opto_samples) {
+    zc_snapshot_t snapshot = zc_get_snapshot();
+    uint8_t failed;
+
+    if (snapshot.i_crossings == checked_crossings) {
+        return;
+    }
+    checked_crossings = snapshot.i_crossings;
+
+    if (opto_samples == checked_opto_samples) {
+        failed = 1;  // The samples see both waveforms but the optocouplers went quiet
+    } else {
+        float difference = opto_deg - (float)snapshot.angle_q15 * (360.0f / 65536.0f);
+        if (difference > 180.0f) {
+            difference -= 360.0f;
+        } else if (difference < -180.0f) {
+            difference += 360.0f;
+        }
+        diagnostics.difference_deg = difference;
+        failed = (fabsf(difference) > ZC_CROSSCHECK_TOL_DEG);
+    }
+    checked_opto_samples = opto_samples;
+
+    if (!failed) {
+        failed_checks = 0;
+        diagnostics.mismatch = 0;
+    } else if (failed_checks < ZC_CROSSCHECK_COUNT && ++failed_checks == ZC_CROSSCHECK_COUNT) {
+        diagnostics.mismatch = 1;
+        diagnostics.mismatch_events++;
+    }
+}
+
+/**
+ * @brief Returns the cross-check diagnostic.
+ *
+ * @return Mismatch state and counters.
+ */
+zc_diagnostics_t zc_get_diagnostics(void) {
+    return diagnostics;
+}